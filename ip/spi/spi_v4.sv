@@ -6,19 +6,19 @@ module SPI_slave_v4(
   output logic LED1,
   output logic LED2,
   output logic LED3,
-  output spi_reset, // SPI was sent a reset command.
+  output logic spi_reset, // SPI was sent a reset command.
   // SPI
   input  SCK,
   input  MOSI,
-  output MISO,
+  output logic MISO,
   input  SSEL,
   // AXI-Stream
-  output [WIDTH-1:0] read_data,
-  output read_vld,
+  output logic [WIDTH-1:0] read_data,
+  output logic read_vld,
   input  read_rdy,
   input  [WIDTH-1:0] write_data,
   input  write_vld,
-  output write_rdy
+  output logic write_rdy
 );
 parameter WIDTH = 8;
 parameter DEPTH = 16;
@@ -28,13 +28,13 @@ localparam DEPTH_BITS = $clog2(DEPTH);
 
 // Default spi_reset to 0
 initial spi_reset = 0;
-logic reset_n = ~reset;
+wire reset_n = ~reset;
 
 /* Recieve SPI Data */
-logic SSEL_active = ~SSEL;
+wire SSEL_active = ~SSEL;
 logic SSEL_previous;
-logic SSEL_startmessage = (SSEL_previous == 1 && SSEL == 0);  // message starts at falling edge
-logic SSEL_endmessage = (SSEL_previous == 0 && SSEL == 1);  // message stops at rising edge
+wire SSEL_startmessage = (SSEL_previous == 1 && SSEL == 0);  // message starts at falling edge
+wire SSEL_endmessage = (SSEL_previous == 0 && SSEL == 1);  // message stops at rising edge
 
 always_ff @(posedge SCK) SSEL_previous <= SSEL;
 
@@ -63,7 +63,8 @@ always_ff @(negedge SCK) begin
 end
 
 always_ff @(negedge SCK) begin
-  if ((parser_state == PARSER_WRITE || parser_state == PARSER_WRITE_READ) && (bitcnt==WIDTH-1)) begin
+  if ((parser_state == PARSER_WRITE || parser_state == PARSER_WRITE_READ ||
+      (parser_state == PARSER_XFER_DATA && xfer_wlen != 0)) && (bitcnt==WIDTH-1)) begin
     write_fifo_write_enable = 1'b1;
   end
   else begin
@@ -78,18 +79,32 @@ end
 
 /* Parser State Machine */
 localparam [WIDTH-1:0]
-  OP_READ_STATUS      = WIDTH'b10000001,
-  OP_READ_BYTES       = WIDTH'b10000010,
-  OP_WRITE_BYTES      = WIDTH'b00000100,
-  OP_WRITE_READ_BYTES = WIDTH'b10000110,
-  OP_RESET            = WIDTH'b00001000;
+  OP_READ_STATUS      = 8'b10000001,
+  OP_READ_BYTES       = 8'b10000010,
+  OP_WRITE_BYTES      = 8'b00000100,
+  OP_WRITE_READ_BYTES = 8'b10000110,
+  OP_XFER             = 8'b10000111,
+  OP_RESET            = 8'b00001000;
+
+// OP_XFER: full duplex transfer with the status in the same frame
+//   MOSI: OP_XFER  WLEN        RLEN        D0 D1 ... (max(WLEN, RLEN) bytes)
+//   MISO: -        write_avail read_count  R0 R1 ...
+// The first WLEN data bytes go to the write FIFO and the first RLEN bytes
+// returned come from the read FIFO (zeros after that). The master sizes
+// WLEN/RLEN from the status of its previous frame, which stays valid as
+// only the master itself can use up write space or read data.
+logic [7:0] xfer_wlen;  // data bytes left to write, including the current one
+logic [7:0] xfer_rlen;  // data bytes left to read, including the current one
 
 typedef enum {
   PARSER_IDLE,
   PARSER_STATUS_AVAIL,
   PARSER_READ,
   PARSER_WRITE,
-  PARSER_WRITE_READ
+  PARSER_WRITE_READ,
+  PARSER_XFER_WLEN,
+  PARSER_XFER_RLEN,
+  PARSER_XFER_DATA
 } parser_state_t;
 parser_state_t parser_state;
 initial parser_state = PARSER_IDLE;
@@ -105,6 +120,8 @@ always_ff @(posedge SCK, posedge SSEL) begin
     byte_data_to_send <= 0;
     byte_data_sent <= 0;  
     bitcnt <= 0;
+    xfer_wlen <= 0;
+    xfer_rlen <= 0;
   end
 
   else begin // SSEL_active
@@ -116,7 +133,6 @@ always_ff @(posedge SCK, posedge SSEL) begin
     // byte_data_sent <= byte_data_to_send;  
     byte_data_sent <= {byte_data_sent[WIDTH-2:0], 1'b0};
     if (byte_received) begin
-      bit_count <= 1;
       unique case(parser_state)
 
       PARSER_IDLE: begin
@@ -142,6 +158,11 @@ always_ff @(posedge SCK, posedge SSEL) begin
             byte_data_sent <= read_fifo_read_data;
           end
 
+          OP_XFER: begin
+            parser_state <= PARSER_XFER_WLEN;
+            byte_data_sent <= write_fifo_avail;
+          end
+
           OP_RESET: begin
             spi_reset <= 1'b1;
           end
@@ -171,6 +192,24 @@ always_ff @(posedge SCK, posedge SSEL) begin
         // write_fifo_write_data = byte_data_received;
         // write_fifo_write_enable = 1'b1;
       end
+
+      PARSER_XFER_WLEN: begin
+        parser_state <= PARSER_XFER_RLEN;
+        xfer_wlen <= byte_data_received;
+        byte_data_sent <= read_fifo_count;
+      end
+
+      PARSER_XFER_RLEN: begin
+        parser_state <= PARSER_XFER_DATA;
+        xfer_rlen <= byte_data_received;
+        if (byte_data_received != 0) byte_data_sent <= read_fifo_read_data;
+      end
+
+      PARSER_XFER_DATA: begin
+        if (xfer_wlen != 0) xfer_wlen <= xfer_wlen - 1;
+        if (xfer_rlen != 0) xfer_rlen <= xfer_rlen - 1;
+        if (xfer_rlen > 1) byte_data_sent <= read_fifo_read_data;
+      end
       
       default: begin
         parser_state <= PARSER_IDLE;
@@ -179,7 +218,8 @@ always_ff @(posedge SCK, posedge SSEL) begin
     end
 
     if(bitcnt==2) begin
-      if (parser_state == PARSER_READ || parser_state == PARSER_WRITE_READ) begin
+      if (parser_state == PARSER_READ || parser_state == PARSER_WRITE_READ ||
+         (parser_state == PARSER_XFER_DATA && xfer_rlen != 0)) begin
         read_fifo_read_enable <= 1'b1;
       end
     end
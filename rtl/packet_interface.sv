@@ -52,7 +52,9 @@ module packet_interface(
     output logic [7:0]  metric_addr,
     input        [7:0]  metric_value,
     output logic        metric_read,
+    output logic        metric_all,     // read is a Get All Metrics snapshot
     input               metric_send,
+    input       [111:0] metric_snapshot,
 
     // Host -> uCaspian
     input        [7:0]  rx_packet_data,
@@ -71,14 +73,17 @@ localparam [7:0]
     OP_NOOP      = 8'b00000000,
     OP_STEP      = 8'b00000001,
     OP_METRIC    = 8'b00000010,
+    OP_METRIC_ALL = 8'b00000011,
     OP_CLR_ACT   = 8'b00000100,
     OP_CLR_CFG   = 8'b00000101,
+    OP_FIRES     = 8'b00000110,
+    OP_FIRE_MAP  = 8'b00000111,
     OP_CFG_NE    = 8'b00001000,
     OP_CFG_SYN   = 8'b00010000,
     OP_CFG_SYNS  = 8'b00010001;
 
 // Rx state machine
-localparam [2:0]
+localparam [3:0]
     RX_IDLE      = 0,
     RX_FIRE      = 1,
     RX_STEP      = 2,
@@ -86,9 +91,13 @@ localparam [2:0]
     RX_CFG_SYN   = 4,
     RX_METRIC    = 5,
     RX_CLEAR_ACT = 6,
-    RX_CLEAR_CFG = 7;
+    RX_CLEAR_CFG = 7,
+    RX_CFG_SYNS  = 8,
+    RX_METRIC_ALL = 9,
+    RX_FIRES     = 10,
+    RX_FIRE_MAP  = 11;
 
-logic [2:0]  rx_state;
+logic [3:0]  rx_state;
 logic [2:0]  rx_read_bytes;
 logic [7:0]  rx_opcode;
 
@@ -104,6 +113,28 @@ end
 logic cfg_read_done;
 logic metric_sent;
 
+// Configure Synapses range state
+logic [11:0] cfg_syn_end;
+logic        cfg_syn_first;
+logic        cfg_syn_target;
+logic        cfg_ack_mask;  // suppress acks until the last synapse of a range
+
+// Input Fires / Input Fire Bitmap state
+logic [7:0]  fire_left;     // id & value pairs / bitmap bytes still to read
+logic        fire_have_id;
+logic [7:0]  fire_bits;     // inputs of the current bitmap byte not yet sent
+logic [7:0]  fire_base;     // input of bit 0 of the current bitmap byte
+logic [7:0]  fire_next;     // input of bit 0 of the next bitmap byte
+
+// lowest input of the current bitmap byte still to be sent
+logic [3:0]  fire_bit;
+logic        fire_bits_none;
+find_set_bit_16 fire_bit_inst(
+    .in({8'b0, fire_bits}),
+    .out(fire_bit),
+    .none_found(fire_bits_none)
+);
+
 initial rx_state = RX_IDLE;
 initial metric_sent = 0;
 
@@ -127,6 +158,16 @@ always @(posedge clk) begin
             rx_rdy        <= 1;
             cfg_read_done <= 0;
             metric_read   <= 0;
+            metric_all    <= 0;
+
+            cfg_syn_end    <= 0;
+            cfg_syn_first  <= 1;
+            cfg_syn_target <= 0;
+            cfg_ack_mask   <= 0;
+
+            fire_left      <= 0;
+            fire_have_id   <= 0;
+            fire_bits      <= 0;
 
             input_fire_waiting <= 0;
             input_fire_addr    <= 0;
@@ -144,6 +185,11 @@ always @(posedge clk) begin
                 case(rx_packet_data)
                     OP_STEP:     rx_state <= RX_STEP;
                     OP_METRIC:   rx_state <= RX_METRIC;
+                    OP_METRIC_ALL: begin
+                        // no additional info, so set rdy to 0
+                        rx_state <= RX_METRIC_ALL;
+                        rx_rdy   <= 0;
+                    end
                     OP_CLR_ACT: begin
                         // no additional info, so set rdy to 0
                         rx_state <= RX_CLEAR_ACT;
@@ -156,7 +202,9 @@ always @(posedge clk) begin
                     end
                     OP_CFG_NE:   rx_state <= RX_CFG_NE;
                     OP_CFG_SYN:  rx_state <= RX_CFG_SYN;
-                    OP_CFG_SYNS: rx_state <= RX_CFG_SYN;
+                    OP_CFG_SYNS: rx_state <= RX_CFG_SYNS;
+                    OP_FIRES:    rx_state <= RX_FIRES;
+                    OP_FIRE_MAP: rx_state <= RX_FIRE_MAP;
                     default: begin
                         if(rx_packet_data[7]) begin
                             rx_state <= RX_FIRE;
@@ -191,6 +239,93 @@ always @(posedge clk) begin
                 rx_rdy <= 1;
             end
         end
+        RX_FIRES: begin
+            // Send each id & value pair to the core like an Input Fire
+            if(input_fire_waiting) begin
+                if(input_fire_ack) begin
+                    input_fire_waiting <= 0;
+                    rx_rdy             <= 1;
+                    if(fire_left == 0) rx_state <= RX_IDLE;
+                end
+            end
+            else if(rx_packet_rdy && rx_packet_vld) begin
+                rx_read_bytes <= 1;
+                if(rx_read_bytes == 0) begin
+                    // Number of pairs
+                    fire_left <= rx_packet_data;
+                    rx_rdy    <= 1;
+                    if(rx_packet_data == 0) rx_state <= RX_IDLE;
+                end
+                else if(!fire_have_id) begin
+                    input_fire_addr <= rx_packet_data;
+                    fire_have_id    <= 1;
+                    rx_rdy          <= 1;
+                end
+                else begin
+                    input_fire_value   <= rx_packet_data;
+                    input_fire_waiting <= 1;
+                    fire_have_id       <= 0;
+                    fire_left          <= fire_left - 1;
+                end
+            end
+            else begin
+                rx_rdy <= 1;
+            end
+        end
+        RX_FIRE_MAP: begin
+            // Send an input fire of the same value for every set bit
+            if(input_fire_waiting) begin
+                if(input_fire_ack) begin
+                    input_fire_waiting <= 0;
+                    // the next byte is read once this one is done
+                    if(fire_bits_none) begin
+                        rx_rdy <= 1;
+                        if(fire_left == 0) rx_state <= RX_IDLE;
+                    end
+                end
+            end
+            else if(rx_read_bytes < 3) begin
+                if(rx_packet_rdy && rx_packet_vld) begin
+                    rx_read_bytes <= rx_read_bytes + 1;
+                    rx_rdy        <= 1;
+                    case(rx_read_bytes)
+                        // Input value
+                        0: input_fire_value <= rx_packet_data;
+                        // First input
+                        1: fire_next <= rx_packet_data;
+                        // Number of bitmap bytes
+                        default: begin
+                            fire_left <= rx_packet_data;
+                            if(rx_packet_data == 0) rx_state <= RX_IDLE;
+                        end
+                    endcase
+                end
+                else begin
+                    rx_rdy <= 1;
+                end
+            end
+            else if(!fire_bits_none) begin
+                input_fire_addr    <= fire_base + {4'b0, fire_bit};
+                input_fire_waiting <= 1;
+                fire_bits[fire_bit[2:0]] <= 0;
+            end
+            else if(fire_left == 0) begin
+                rx_state <= RX_IDLE;
+                rx_rdy   <= 1;
+            end
+            else if(rx_packet_rdy && rx_packet_vld) begin
+                // Bitmap byte, bit i (LSB first) is input fire_next + i
+                fire_bits <= rx_packet_data;
+                fire_base <= fire_next;
+                fire_next <= fire_next + 8'd8;
+                fire_left <= fire_left - 1;
+                // an empty byte goes straight on to the next one
+                if(rx_packet_data == 0 && fire_left != 1) rx_rdy <= 1;
+            end
+            else begin
+                rx_rdy <= 1;
+            end
+        end
         RX_STEP: begin
             // Advance the target time by the specified number of steps
             //   Note: this is relative to the current target time
@@ -320,6 +455,54 @@ always @(posedge clk) begin
                 rx_rdy <= 1;
             end
         end
+        RX_CFG_SYNS: begin
+            // Configure the synapses [start, end] from weight & target pairs.
+            //   Each pair is written like a single synapse, but only the
+            //   last one is acknowledged.
+            cfg_synapse <= 1;
+            if(cfg_read_done) begin
+                cfg_addr      <= 0;
+                cfg_value     <= 0;
+                cfg_byte      <= MAX_CFG_BYTE;
+                rx_rdy        <= 0;
+                rx_state      <= RX_IDLE;
+            end
+            else if(rx_packet_rdy && rx_packet_vld) begin
+                if(rx_read_bytes < 4) rx_read_bytes <= rx_read_bytes + 1;
+                cfg_read_done <= 0;
+                case(rx_read_bytes)
+                    // Range start
+                    0: cfg_addr[11:8]    <= rx_packet_data[3:0];
+                    1: cfg_addr[7:0]     <= rx_packet_data;
+                    // Range end (inclusive)
+                    2: cfg_syn_end[11:8] <= rx_packet_data[3:0];
+                    3: cfg_syn_end[7:0]  <= rx_packet_data;
+                    default: begin
+                        if(!cfg_syn_target) begin
+                            // Synaptic weight
+                            if(!cfg_syn_first) cfg_addr <= cfg_addr + 1;
+                            cfg_value[11:8] <= 0;
+                            cfg_value[7:0]  <= rx_packet_data;
+                            cfg_byte        <= 2;
+                            cfg_syn_target  <= 1;
+                        end
+                        else begin
+                            // Target neuron address
+                            cfg_value[11:8] <= 0;
+                            cfg_value[7:0]  <= rx_packet_data;
+                            cfg_byte        <= 3;
+                            cfg_syn_first   <= 0;
+                            cfg_syn_target  <= 0;
+                            cfg_ack_mask    <= (cfg_addr != cfg_syn_end);
+                            cfg_read_done   <= (cfg_addr == cfg_syn_end);
+                        end
+                    end
+                endcase
+            end
+            else begin
+                rx_rdy <= 1;
+            end
+        end
         RX_METRIC: begin
             // Request the specified metric register
             if(metric_sent) begin
@@ -329,6 +512,7 @@ always @(posedge clk) begin
             else if(!metric_read) begin
                 if(rx_packet_rdy && rx_packet_vld) begin
                     metric_addr <= rx_packet_data;
+                    metric_all  <= 0;
                     metric_read <= 1;
                 end
                 else begin
@@ -336,6 +520,17 @@ always @(posedge clk) begin
                 end
             end
         end
+        RX_METRIC_ALL: begin
+            // Latch & send every metric counter
+            if(metric_sent) begin
+                metric_read <= 0;
+                rx_state    <= RX_IDLE;
+            end
+            else begin
+                metric_all  <= 1;
+                metric_read <= 1;
+            end
+        end
         RX_CLEAR_ACT: begin
             // Clear activity in the network
             clear_act <= 1;
@@ -367,6 +562,16 @@ always @(posedge clk) begin
         cfg_read_done <= 0;
         rx_opcode     <= 0;
         rx_state      <= RX_IDLE;
+        metric_all    <= 0;
+
+        cfg_syn_end    <= 0;
+        cfg_syn_first  <= 1;
+        cfg_syn_target <= 0;
+        cfg_ack_mask   <= 0;
+
+        fire_left      <= 0;
+        fire_have_id   <= 0;
+        fire_bits      <= 0;
     end
 end
 
@@ -381,7 +586,7 @@ localparam [2:0]
 
 logic [2:0] tx_state;
 logic [2:0] tx_state_reg;
-logic [2:0] tx_write_bytes;
+logic [3:0] tx_write_bytes;
 logic [7:0] tx_data;
 
 logic ack_sent_sig, time_sent_sig, metric_sent_sig, out_fire_sent_sig;
@@ -472,7 +677,7 @@ always_comb begin
             else if(step_send && !time_sent)                  tx_state = TX_STEP;
             else if(output_fire_waiting && !output_fire_sent) tx_state = TX_FIRE;
             else if(metric_send && !metric_sent)              tx_state = TX_METRIC;
-            else if(cfg_done && !ack_sent)                    tx_state = TX_ACK_CFG;
+            else if(cfg_done && !ack_sent && !cfg_ack_mask)   tx_state = TX_ACK_CFG;
             else if(clear_done && !ack_sent)                  tx_state = TX_ACK_CLR;
             else                                              tx_state = TX_IDLE;
         end
@@ -509,14 +714,24 @@ always_comb begin
         end
 
         TX_METRIC: begin
-            tx_send = (tx_write_bytes < 3);
-            metric_sent_sig = ~tx_send;
+            if(metric_all) begin
+                // opcode, then the 14 byte snapshot, most significant first
+                tx_send = (tx_write_bytes < 15);
+                metric_sent_sig = ~tx_send;
 
-            case(tx_write_bytes)
-                0: tx_data  = 8'b00000010;
-                1: tx_data  = metric_addr;
-                2: tx_data  = metric_value;
-            endcase
+                if(tx_write_bytes == 0) tx_data = 8'b00000011;
+                else if(tx_send)        tx_data = metric_snapshot[8*(14 - tx_write_bytes) +: 8];
+            end
+            else begin
+                tx_send = (tx_write_bytes < 3);
+                metric_sent_sig = ~tx_send;
+
+                case(tx_write_bytes)
+                    0: tx_data  = 8'b00000010;
+                    1: tx_data  = metric_addr;
+                    2: tx_data  = metric_value;
+                endcase
+            end
 
             // end of state
             //if(!tx_send && metric_sent && !metric_read) tx_state = TX_IDLE;
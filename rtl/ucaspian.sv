@@ -31,7 +31,7 @@ module ucaspian(
 wire output_fire_waiting, cfg_done, metric_send, clear_done,
     time_update, core_active, time_target_ack, time_remaining;
 
-wire output_fire_sent, ack_sent, time_sent, metric_read,
+wire output_fire_sent, ack_sent, time_sent, metric_read, metric_all,
     input_fire_waiting, input_fire_ack, clear_act, clear_config,
     cfg_synapse, time_target_waiting;
 
@@ -45,6 +45,7 @@ wire [11:0] cfg_addr;
 wire [11:0] cfg_value;
 wire [7:0]  metric_addr;
 wire [7:0]  metric_value;
+wire [111:0] metric_snapshot;
 
 //////
 // Packet Interface
@@ -98,7 +99,9 @@ packet_interface pck_ctrl_inst(
     .metric_addr(metric_addr),
     .metric_value(metric_value),
     .metric_send(metric_send),
-    .metric_read(metric_read)
+    .metric_read(metric_read),
+    .metric_all(metric_all),
+    .metric_snapshot(metric_snapshot)
 );
 
 // uCaspian Core
@@ -148,7 +151,9 @@ ucaspian_core core(
     .metric_addr(metric_addr),
     .metric_value(metric_value),
     .metric_send(metric_send),
-    .metric_read(metric_read)
+    .metric_read(metric_read),
+    .metric_all(metric_all),
+    .metric_snapshot(metric_snapshot)
 );
 
 endmodule
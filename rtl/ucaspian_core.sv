@@ -34,7 +34,9 @@ module ucaspian_core(
     input        [7:0]  metric_addr,
     output logic [7:0]  metric_value,
     input               metric_read,
+    input               metric_all,
     output logic        metric_send,
+    output logic [111:0] metric_snapshot, // {spikes, accumulations, active cycles[47:0]}
 
     // input fire interface
     input        [7:0]  input_fire_addr,
@@ -463,8 +465,16 @@ fire_dispatch fire_dispatch_inst(
 // Metrics -- TODO: make this into a better module
 
 logic [31:0] metric_acc_cnt; // accumualtions / synops
-logic [24:0] metric_spk_cnt; // spikes
-logic [31:0] metric_clk_cnt; // active clock cycles
+logic [31:0] metric_spk_cnt; // spikes
+
+// active clock cycles, 48 bits wide with METRIC_CLK_48 defined
+`ifdef METRIC_CLK_48
+logic [47:0] metric_clk_cnt;
+wire  [47:0] metric_clk_wide = metric_clk_cnt;
+`else
+logic [31:0] metric_clk_cnt;
+wire  [47:0] metric_clk_wide = {16'b0, metric_clk_cnt};
+`endif
 
 logic [7:0]  metric_lst_addr;
 logic        metric_lst_clear;
@@ -502,12 +512,28 @@ always @(posedge clk) begin
         metric_send_reg  <= 0;
         metric_lst_addr  <= 0;
         metric_lst_clear <= 0;
+        metric_snapshot  <= 0;
+    end
+    else if(metric_read && metric_all) begin
+        // Latch every counter at once on the first cycle of the read and
+        // restart them, keeping any event counted in this same cycle
+        if(!metric_send_reg) begin
+            metric_snapshot <= {metric_spk_cnt, metric_acc_cnt, metric_clk_wide};
+            metric_acc_cnt  <= (dend_rdy && dend_vld);
+            metric_spk_cnt  <= (axon_rdy && axon_vld);
+            metric_clk_cnt  <= (core_active || core_active_reg[0] || core_active_reg[1]);
+        end
+
+        metric_value     <= 0;
+        metric_send_reg  <= 1;
+        metric_lst_addr  <= metric_addr;
+        metric_lst_clear <= 0;
     end
     else if(metric_read) begin
         case(metric_addr)
 
             // Spike Count
-            1:  metric_value <= 0; // only 24-bits for now with space to go to 32-bits
+            1:  metric_value <= metric_spk_cnt[31:24];
             2:  metric_value <= metric_spk_cnt[23:16];
             3:  metric_value <= metric_spk_cnt[15:8];
             4:  metric_value <= metric_spk_cnt[7:0];
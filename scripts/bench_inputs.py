@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+# Dense input benchmark
+#
+# Builds a random network and a run of dense input timesteps with
+# build/ucaspian_inputs and runs the Input Fire, Input Fires, and Input Fire
+# Bitmap packet files through the Verilator model until quiescent, reporting
+# the bytes and clock cycles per timestep of each. Both include the
+# one-off configuration, which every file shares. The three files, and the
+# two files firing inputs 192-255 and 0-63, must produce the same output.
+#
+# usage: bench_inputs.py (timesteps) (density) (seed) (model)
+#   make tools test-notrace first; model defaults to vout_notrace/Vucaspian,
+#   'engine' runs the reference engine instead (bytes only, no cycles)
+
+import os
+import subprocess
+import sys
+import tempfile
+
+import simrun
+
+timesteps = sys.argv[1] if len(sys.argv) > 1 else '1000'
+density   = sys.argv[2] if len(sys.argv) > 2 else '0.25'
+seed      = sys.argv[3] if len(sys.argv) > 3 else '1'
+model     = sys.argv[4] if len(sys.argv) > 4 else simrun.default_model
+
+
+def run(input_file):
+    """Cycles (None for the engine) and output bytes of input_file"""
+    if model == 'engine':
+        return None, simrun.read(simrun.engine(input_file))
+    cycles = simrun.simulate(model, input_file)
+    return cycles, simrun.read(input_file + '.out')
+
+
+formats = [('input fire', 'fire.bin'), ('input fires', 'fires.bin'), ('fire bitmap', 'map.bin')]
+wrap    = ['wrap_fires.bin', 'wrap_map.bin']
+steps   = int(timesteps)
+
+with tempfile.TemporaryDirectory() as tmp:
+    files      = [os.path.join(tmp, f) for _, f in formats]
+    wrap_files = [os.path.join(tmp, f) for f in wrap]
+
+    res = subprocess.run([simrun.tool('ucaspian_inputs')] + files + [timesteps, density, seed] + wrap_files,
+                         stdout=subprocess.PIPE, universal_newlines=True)
+    print(res.stdout, end='')
+    if res.returncode != 0:
+        sys.exit('reference engine outputs differ')
+
+    sizes   = [os.path.getsize(f) for f in files]
+    results = [run(f) for f in files]
+    if any(out != results[0][1] for _, out in results):
+        sys.exit('outputs of the input formats differ')
+
+    wrap_out = [run(f)[1] for f in wrap_files]
+    if wrap_out[0] != wrap_out[1]:
+        sys.exit('outputs of inputs 192-255, 0-63 differ')
+
+print()
+print('{:<14}{:>12}{:>14}{:>14}{:>14}'.format('', 'bytes', 'bytes/step', 'cycles', 'cycles/step'))
+for (name, _), b, (c, _) in zip(formats, sizes, results):
+    if c is None:
+        print('{:<14}{:>12}{:>14.1f}{:>14}{:>14}'.format(name, b, b / steps, '-', '-'))
+    else:
+        print('{:<14}{:>12}{:>14.1f}{:>14}{:>14.1f}'.format(name, b, b / steps, c, c / steps))
+print('outputs match ({} output bytes, {} for inputs 192-255, 0-63)'.format(len(results[0][1]), len(wrap_out[0])))
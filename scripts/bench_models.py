@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+# Verilator model speed comparison
+#
+# Runs the same packet file through each Verilator model variant until
+# quiescent and reports simulated clock cycles per second of wall time.
+# Every variant must produce the same output bytes and cycle count.
+#
+# usage: bench_models.py (input_file) (repeats) (model ...)
+#   input_file defaults to the PGO workload (make build/pgo_workload.bin);
+#   models default to the single-threaded, multithreaded and profile-guided
+#   builds (make test-notrace test-mt test-pgo), missing ones are skipped
+
+import os
+import sys
+import tempfile
+import time
+
+import simrun
+
+root = simrun.root
+
+input_file = sys.argv[1] if len(sys.argv) > 1 else os.path.join(root, 'build', 'pgo_workload.bin')
+repeats    = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+models     = sys.argv[3:] or [os.path.join(root, d, 'Vucaspian') for d in ('vout_notrace', 'vout_mt', 'vout_pgo')]
+
+
+def simulate(model, output_file):
+    start = time.perf_counter()
+    cycles = simrun.simulate(model, input_file, output_file)
+    return cycles, time.perf_counter() - start
+
+
+if not os.path.exists(input_file):
+    sys.exit('missing input file ' + input_file)
+
+results = []
+reference = None
+
+with tempfile.TemporaryDirectory() as tmp:
+    for model in models:
+        if not os.path.exists(model):
+            print('skipping missing model', model)
+            continue
+
+        output_file = os.path.join(tmp, 'out.bin')
+        best = None
+        for _ in range(repeats):
+            cycles, seconds = simulate(model, output_file)
+            best = seconds if best is None else min(best, seconds)
+
+        with open(output_file, 'rb') as f:
+            output = f.read()
+        if reference is None:
+            reference = (cycles, output)
+        elif (cycles, output) != reference:
+            sys.exit(model + ' differs from ' + results[0][0])
+
+        results.append((model, cycles, best))
+
+if not results:
+    sys.exit('no models to run')
+
+print()
+print('{:<28}{:>14}{:>10}{:>16}{:>10}'.format('model', 'cycles', 'seconds', 'cycles/s', 'speedup'))
+for model, cycles, seconds in results:
+    name = os.path.relpath(model, root)
+    print('{:<28}{:>14}{:>10.3f}{:>16.0f}{:>9.2f}x'.format(name, cycles, seconds, cycles / seconds,
+                                                           results[0][2] / seconds))
@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+# Differential reconfiguration benchmark
+#
+# Builds a chain of mutated networks with build/ucaspian_mutate and runs the
+# full-reload and differential packet files through the Verilator model
+# until quiescent, reporting the bytes and clock cycles each one takes.
+#
+# usage: bench_reconfig.py (networks) (seed) (model)
+#   make tools test-notrace first; model defaults to vout_notrace/Vucaspian
+
+import os
+import subprocess
+import sys
+import tempfile
+
+import simrun
+
+networks = sys.argv[1] if len(sys.argv) > 1 else '200'
+seed     = sys.argv[2] if len(sys.argv) > 2 else '1'
+model    = sys.argv[3] if len(sys.argv) > 3 else simrun.default_model
+mutate   = simrun.tool('ucaspian_mutate')
+
+with tempfile.TemporaryDirectory() as tmp:
+    full = os.path.join(tmp, 'full.bin')
+    diff = os.path.join(tmp, 'diff.bin')
+
+    res = subprocess.run([mutate, full, diff, networks, seed],
+                         stdout=subprocess.PIPE, universal_newlines=True)
+    print(res.stdout, end='')
+    if res.returncode != 0:
+        sys.exit('reference engine outputs differ')
+
+    full_bytes, diff_bytes = os.path.getsize(full), os.path.getsize(diff)
+    full_cycles, diff_cycles = simrun.simulate(model, full), simrun.simulate(model, diff)
+
+print()
+print('{:<14}{:>12}{:>14}'.format('', 'bytes', 'cycles'))
+print('{:<14}{:>12}{:>14}'.format('full reload', full_bytes, full_cycles))
+print('{:<14}{:>12}{:>14}'.format('differential', diff_bytes, diff_cycles))
+print('{:<14}{:>11.1f}x{:>13.1f}x'.format('saved', full_bytes / diff_bytes, full_cycles / diff_cycles))
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+# Verilator model checks against the reference engine
+#
+# Builds a random network as a network file, compiles it with
+# build/ucaspian_compile into Configure Neuron packets and one Configure
+# Synapses range, writes the synapses again as ranges of random lengths
+# (single synapses as Configure Synapse), then adds input fires and runs.
+# Both the model and the engine run it:
+#
+#   ranges    the model must answer one CFG_ACK per configuration packet,
+#             and its acks, time updates and fires must equal the engine's.
+#   metrics   the same stimulus followed by Get All Metrics, and again
+#             followed by Get Metric 1-12 and 255. The snapshot must equal
+#             the twelve bytes read one by one, spikes & accumulations must
+#             equal the engine's, and address 255 must answer a plain 0.
+#
+# Active cycle counts are not modelled by the engine and only compared
+# between the two model runs.
+#
+# usage: check_model.py ranges|metrics (seed) (model)
+#   make tools test-notrace first; model defaults to vout_notrace/Vucaspian,
+#   'engine' checks the script itself against the engine
+
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+import simrun
+
+check = sys.argv[1] if len(sys.argv) > 1 else 'ranges'
+seed  = int(sys.argv[2]) if len(sys.argv) > 2 else 1
+model = sys.argv[3] if len(sys.argv) > 3 else simrun.default_model
+
+NEURONS = 256
+INPUTS  = 64
+OUTPUTS = 32
+
+
+def network_file(fname, rng):
+    """Random network with fan-outs from 0 to 200"""
+    lines = []
+    synapses = 0
+    for n in range(NEURONS):
+        lines.append('N {} {} -1 0 {}'.format(n, rng.randint(0, 100), int(n >= NEURONS - OUTPUTS)))
+    for n in range(NEURONS - OUTPUTS):
+        fan_out = 200 if n % 37 == 0 else rng.randint(0, 12)
+        fan_out = min(fan_out, 4096 - synapses)
+        synapses += fan_out
+        for _ in range(fan_out):
+            lines.append('S {} {} {}'.format(n, rng.randint(INPUTS, NEURONS - 1), rng.randint(-32, 96)))
+    with open(fname, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+def recut(config, rng):
+    """The synapses of the compiled range again, in ranges of 1 to 300"""
+    i = next(offset for op, offset in simrun.tx_packets(config) if op == 0x11)
+    start = ((config[i + 1] & 0x0F) << 8) | config[i + 2]
+    pairs = config[i + 5:]
+
+    out = bytearray()
+    while pairs:
+        n = min(rng.choice([1, 2, 3, 17, 255, 256, 300]), len(pairs) // 2)
+        end = start + n - 1
+        if n == 1:
+            out += bytes([0x10, start >> 8, start & 0xFF]) + pairs[:2]
+        else:
+            out += bytes([0x11, start >> 8, start & 0xFF, end >> 8, end & 0xFF]) + pairs[:2 * n]
+        start += n
+        pairs = pairs[2 * n:]
+    return bytes(out)
+
+
+def inputs(rng):
+    """40 steps of 16 input fires and a run of 1-3 timesteps"""
+    out = bytearray()
+    for _ in range(40):
+        for i in rng.sample(range(INPUTS), 16):
+            out += bytes([0x80 | i, rng.randint(1, 255)])
+        out += bytes([0x01, rng.randint(1, 3)])
+    return bytes(out)
+
+
+def run(input_bytes, fname):
+    """Decoded output of the model (cycles masked for the engine) and engine"""
+    with open(fname, 'wb') as f:
+        f.write(input_bytes)
+    expected = simrun.decode(simrun.read(simrun.engine(fname, fname + '.engine')))
+    if model == 'engine':
+        return expected, expected
+    simrun.simulate(model, fname, fname + '.out')
+    return simrun.decode(simrun.read(fname + '.out')), expected
+
+
+def without_cycles(packets):
+    """Active cycle counts zeroed as the engine reports them"""
+    out = []
+    for name, data in packets:
+        if name == 'metric_all':
+            data = data[:8] + bytes(6)
+        elif name == 'metric' and 9 <= data[0] <= 12:
+            data = data[:1] + bytes(1)
+        out.append((name, bytes(data)))
+    return out
+
+
+def fail(what):
+    sys.exit('FAIL ' + check + ': ' + what)
+
+
+rng = random.Random(seed)
+
+with tempfile.TemporaryDirectory() as tmp:
+    net = os.path.join(tmp, 'net.txt')
+    cfg = os.path.join(tmp, 'cfg.bin')
+    network_file(net, rng)
+    subprocess.run([simrun.tool('ucaspian_compile'), '--clear', net, cfg], check=True)
+    config   = simrun.read(cfg)
+    stimulus = config + recut(config, rng) + inputs(rng)
+
+    if check == 'ranges':
+        got, expected = run(stimulus, os.path.join(tmp, 'ranges.bin'))
+
+        ops  = [op for op, _ in simrun.tx_packets(stimulus)]
+        acks = sum(1 for op in ops if op in (0x08, 0x10, 0x11))
+        seen = sum(1 for name, _ in got if name == 'cfg_ack')
+        if seen != acks:
+            fail('{} CFG_ACKs for {} configuration packets'.format(seen, acks))
+        if got != expected:
+            fail('model output differs from the engine')
+
+        print('ranges: {} ranges, {} single synapses, {} acks, {} output packets match the engine'.format(
+            ops.count(0x11), ops.count(0x10), seen, len(got)))
+
+    elif check == 'metrics':
+        singles = bytes(b for addr in list(range(1, 13)) + [255] for b in (0x02, addr))
+        all_got, all_expected = run(stimulus + bytes([0x03]), os.path.join(tmp, 'all.bin'))
+        one_got, one_expected = run(stimulus + singles, os.path.join(tmp, 'one.bin'))
+
+        if without_cycles(all_got) != all_expected or without_cycles(one_got) != one_expected:
+            fail('model output differs from the engine')
+
+        snapshot = all_got[-1]
+        reads    = one_got[-13:]
+        if snapshot[0] != 'metric_all' or any(name != 'metric' for name, _ in reads):
+            fail('missing metric responses')
+        if list(reads[-1][1]) != [255, 0]:
+            fail('address 255 answered {}'.format(list(reads[-1][1])))
+
+        # addresses 1-12 are spikes, accumulations, and the low 32 bits of the cycles
+        values = bytes(data[1] for _, data in reads[:12])
+        if values != snapshot[1][:8] + snapshot[1][10:14]:
+            fail('snapshot {} != addresses 1-12 {}'.format(snapshot[1].hex(), values.hex()))
+
+        print('metrics: snapshot {} matches addresses 1-12 and the engine'.format(snapshot[1].hex()))
+
+    else:
+        sys.exit('unknown check ' + check)
@@ -4,6 +4,7 @@ import time
 import random
 import string
 import serial
+import sys
 
 def randomString(stringLength=10):
     """Generate a random string of fixed length """
@@ -31,7 +32,11 @@ def run_test(ser, length):
 
 
 
-with serial.Serial('/dev/ttyUSB0', 3000000, timeout=0.5) as ser:
+# usage: serial_loopback.py (device)
+# e.g. /dev/ttyACM0 for the Pico passthrough built with -DUSB_LOOPBACK=ON
+device = sys.argv[1] if len(sys.argv) > 1 else '/dev/ttyUSB0'
+
+with serial.Serial(device, 3000000, timeout=0.5) as ser:
 
     for i in range(1, 64, 1):
         run_test(ser, i)
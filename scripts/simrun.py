@@ -0,0 +1,94 @@
+# Shared helpers for the simulator scripts
+#
+# Runs packet files through the Verilator model until quiescent or through
+# the reference engine, and decodes the uCaspian -> host stream so outputs
+# can be compared packet by packet. Import from a script in this directory:
+#
+#   import simrun
+#   cycles = simrun.simulate(simrun.default_model, 'input.bin')
+
+import os
+import re
+import subprocess
+import sys
+
+root = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+default_model = os.path.join(root, 'vout_notrace', 'Vucaspian')
+
+# payload bytes following each uCaspian -> host opcode (sim/include/packets.hpp)
+RX_PAYLOAD = {0x18: 0, 0x04: 0, 0x02: 2, 0x03: 14, 0x01: 4}
+RX_NAMES   = {0x18: 'cfg_ack', 0x04: 'clear_ack', 0x02: 'metric', 0x03: 'metric_all', 0x01: 'time', 0x80: 'fire'}
+
+
+def tool(name):
+    return os.path.join(root, 'build', name)
+
+
+def simulate(model, input_file, output_file=None, args=()):
+    """Run input_file on a Verilator model until quiescent, returns the cycle count"""
+    output_file = output_file or input_file + '.out'
+    res = subprocess.run([model] + list(args) + ['--idle', '64', '--no-trace', input_file, output_file, str(2**62)],
+                         check=True, stdout=subprocess.PIPE, universal_newlines=True)
+    m = re.search(r'Quiescent after (\d+) cycles', res.stdout)
+    if m is None:
+        sys.exit('simulation did not go idle: ' + res.stdout)
+    return int(m.group(1))
+
+
+def engine(input_file, output_file=None):
+    """Run input_file through the reference engine, returns the output file"""
+    output_file = output_file or input_file + '.out'
+    subprocess.run([tool('ucaspian_engine'), input_file, output_file], check=True, stdout=subprocess.DEVNULL)
+    return output_file
+
+
+def read(fname):
+    with open(fname, 'rb') as f:
+        return f.read()
+
+
+# payload bytes following each fixed size host -> uCaspian opcode
+TX_PAYLOAD = {0x00: 0, 0x01: 1, 0x02: 1, 0x03: 0, 0x04: 0, 0x05: 0, 0x08: 6, 0x10: 4}
+
+
+def tx_packets(data):
+    """(opcode, offset) of each packet of a host -> uCaspian stream, Input Fire as 0x80"""
+    ops = []
+    i = 0
+    while i < len(data):
+        op = data[i]
+        if op & 0x80:
+            ops.append((0x80, i))
+            i += 2
+            continue
+        ops.append((op, i))
+        if op == 0x11:
+            start = ((data[i + 1] & 0x0F) << 8) | data[i + 2]
+            end   = ((data[i + 3] & 0x0F) << 8) | data[i + 4]
+            i += 5 + 2 * (((end - start) & 0x0FFF) + 1)
+        elif op == 0x06:
+            i += 2 + 2 * data[i + 1]
+        elif op == 0x07:
+            i += 4 + data[i + 3]
+        else:
+            i += 1 + TX_PAYLOAD.get(op, 0)
+    return ops
+
+
+def decode(data):
+    """Packets of a uCaspian -> host stream as (name, payload bytes) tuples"""
+    packets = []
+    i = 0
+    while i < len(data):
+        op = data[i]
+        if op & 0x80:
+            packets.append(('fire', data[i + 1:i + 2]))
+            i += 2
+        elif op in RX_PAYLOAD:
+            n = RX_PAYLOAD[op]
+            packets.append((RX_NAMES[op], data[i + 1:i + 1 + n]))
+            i += 1 + n
+        else:
+            packets.append(('unknown', data[i:i + 1]))
+            i += 1
+    return packets
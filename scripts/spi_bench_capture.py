@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+
+# Capture the CSV printed by the serial_spi_tester benchmark sweep
+# (menu key 'b', or at boot when built with -DSPI_BENCHMARK=ON).
+#
+# usage: spi_bench_capture.py output.csv (device) (baud) (--start)
+#   --start sends 'b' to start the sweep from the menu
+
+import sys
+import serial
+
+if len(sys.argv) < 2:
+    print("usage: {} output.csv (device) (baud) (--start)".format(sys.argv[0]))
+    sys.exit(1)
+
+args = [a for a in sys.argv[1:] if a != '--start']
+output = args[0]
+device = args[1] if len(args) > 1 else '/dev/serial0'
+baud = int(args[2]) if len(args) > 2 else 115200
+
+with serial.Serial(device, baud, timeout=60) as ser, open(output, 'w') as csv:
+    if '--start' in sys.argv:
+        ser.write(b'b')
+
+    started = False
+    rows = 0
+    while True:
+        line = ser.readline()
+        if not line:
+            print("Timed out waiting for the benchmark")
+            sys.exit(1)
+
+        line = line.decode('ascii', errors='replace').strip()
+        if line.startswith('# begin spi benchmark'):
+            started = True
+        elif line.startswith('# end spi benchmark'):
+            break
+        elif started and line:
+            csv.write(line + '\n')
+            if not line.startswith('mode,'):
+                rows += 1
+                print(','.join(line.split(',')[:8]))  # progress: up to mbps
+
+print("Wrote {} configurations to {}".format(rows, output))
@@ -0,0 +1,444 @@
+#pragma once
+
+/* uCaspian reference engine
+ *
+ * Event-driven software model of the uCaspian core. It consumes the same
+ * NeuronConfig/SynapseConfig structures (and the same host packet stream)
+ * as the RTL and produces the same output byte stream, one time step at a
+ * time rather than one clock cycle at a time.
+ *
+ * Semantics follow rtl/ as written, including its current limitations:
+ *  - the 3-bit neuron leak is stored but not applied (see neuron.sv TODO)
+ *  - synapses carry no delay, so SynapseConfig::delay is ignored
+ *  - Clear Configuration does not clear the neuron threshold/output RAM
+ *  - the active clock cycle metric (9-12, and in METRIC_ALL) is not
+ *    modelled and reads as 0
+ */
+
+#include "packets.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class UcaspianEngine
+{
+    public:
+        static constexpr int NUM_NEURONS  = 256;
+        static constexpr int NUM_SYNAPSES = 4096;
+        static constexpr int NUM_GROUPS   = NUM_NEURONS / 16;
+        static constexpr int DELAY_SLOTS  = 16;
+
+        UcaspianEngine()
+        {
+            std::memset(m_threshold, 0, sizeof(m_threshold));
+            std::memset(m_flags, 0, sizeof(m_flags));
+            clear_config();
+        }
+
+        /* Configuration -- equivalent to the CFG_N & CFG_SYN packets */
+        void configure(const NeuronConfig &n)
+        {
+            m_threshold[n.addr] = n.threshold;
+            m_flags[n.addr]     = (n.output << 3) | (n.leak & 0x07);
+            m_delay[n.addr]     = n.delay & 0x0F;
+            m_first_syn[n.addr] = n.first_syn & 0x0FFF;
+            m_syn_cnt[n.addr]   = n.syn_cnt;
+        }
+
+        void configure(const SynapseConfig &s)
+        {
+            uint16_t addr = s.addr & 0x0FFF;
+            m_syn[addr].weight = s.weight;
+            m_syn[addr].target = s.target;
+        }
+
+        /* Reset network time and all activity (charge, dendrites, delays, metrics) */
+        void clear_activity()
+        {
+            std::memset(m_charge, 0, sizeof(m_charge));
+            std::memset(m_dend, 0, sizeof(m_dend));
+            std::memset(m_delayed, 0, sizeof(m_delayed));
+            m_dend_active = 0;
+
+            m_time        = 0;
+            m_target      = 0;
+            m_spk_cnt     = 0;
+            m_acc_cnt     = 0;
+        }
+
+        /* Clears axon & synapse configuration. Like the RTL, this leaves the
+         * neuron threshold/output configuration in place. */
+        void clear_config()
+        {
+            std::memset(m_delay, 0, sizeof(m_delay));
+            std::memset(m_first_syn, 0, sizeof(m_first_syn));
+            std::memset(m_syn_cnt, 0, sizeof(m_syn_cnt));
+            std::memset(m_syn, 0, sizeof(m_syn));
+            clear_activity();
+        }
+
+        /* Input fires accumulate in the dendrite until the next time step */
+        void input_fire(uint8_t id, uint8_t value)
+        {
+            accumulate(id, value);
+        }
+
+        /* Advance the target time and run until it is reached, appending
+         * TIME_UPD & FIRE packets to 'out' exactly as the RTL emits them. */
+        void run(uint8_t steps, std::vector<uint8_t> &out)
+        {
+            m_target += steps;
+
+            while(m_target > m_time)
+            {
+                bool sent_time = step(out);
+
+                // the final time update is always sent at the end of a run
+                if(m_target == m_time && !sent_time)
+                    time_update(out);
+            }
+        }
+
+        /* Read a metric byte (addresses as in ucaspian_core.sv) */
+        uint8_t metric(uint8_t addr)
+        {
+            uint8_t value = 0;
+
+            switch(addr)
+            {
+                case 1:  value = m_spk_cnt >> 24; break;
+                case 2:  value = m_spk_cnt >> 16; break;
+                case 3:  value = m_spk_cnt >> 8;  break;
+                case 4:  value = m_spk_cnt;       break;
+                case 5:  value = m_acc_cnt >> 24; break;
+                case 6:  value = m_acc_cnt >> 16; break;
+                case 7:  value = m_acc_cnt >> 8;  break;
+                case 8:  value = m_acc_cnt;       break;
+                default: value = 0;               break;
+            }
+
+            // the counter resets after its last byte is read
+            if(addr == 4) m_spk_cnt = 0;
+            if(addr == 8) m_acc_cnt = 0;
+
+            return value;
+        }
+
+        /* Consume host -> uCaspian packet bytes. Packets may be split across
+         * calls. Responses are appended to 'out'. Returns bytes consumed. */
+        size_t process(const uint8_t *buf, size_t len, std::vector<uint8_t> &out)
+        {
+            for(size_t i = 0; i < len; ++i)
+            {
+                uint8_t byte = buf[i];
+
+                if(m_syns_left > 0)
+                {
+                    // weight & target pairs of a Configure Synapses range
+                    m_pck[m_pck_len++] = byte;
+                    if(m_pck_len == 2)
+                    {
+                        configure_range_pair(out);
+                        m_pck_len = 0;
+                    }
+                }
+                else if(m_fires_left > 0)
+                {
+                    // id & value pairs of an Input Fires packet
+                    m_pck[m_pck_len++] = byte;
+                    if(m_pck_len == 2)
+                    {
+                        input_fire(m_pck[0], m_pck[1]);
+                        m_fires_left--;
+                        m_pck_len = 0;
+                    }
+                }
+                else if(m_map_left > 0)
+                {
+                    // bitmap bytes of an Input Fire Bitmap, LSB first
+                    for(int b = 0; b < 8; ++b)
+                    {
+                        if(byte & (1 << b)) input_fire(m_map_base + b, m_map_value);
+                    }
+                    m_map_base += 8;
+                    m_map_left--;
+                }
+                else if(m_pck_need == 0)
+                {
+                    m_opcode   = byte;
+                    m_pck_len  = 0;
+                    m_pck_need = tx_payload_size(byte);
+                    if(m_pck_need == 0) execute(out);
+                }
+                else
+                {
+                    m_pck[m_pck_len++] = byte;
+                    if(m_pck_len == m_pck_need)
+                    {
+                        execute(out);
+                        m_pck_need = 0;
+                    }
+                }
+            }
+
+            return len;
+        }
+
+        uint32_t time() const { return m_time; }
+        uint32_t spike_count() const { return m_spk_cnt; }
+        uint32_t accumulate_count() const { return m_acc_cnt; }
+        int16_t  charge(uint8_t n) const { return m_charge[n]; }
+
+    private:
+        struct Synapse
+        {
+            int8_t  weight;
+            uint8_t target;
+        };
+
+        void execute(std::vector<uint8_t> &out)
+        {
+            if(m_opcode & 0x80)
+            {
+                input_fire(m_opcode & 0x7F, m_pck[0]);
+                return;
+            }
+
+            switch(static_cast<TX_PCK>(m_opcode))
+            {
+                case TX_PCK::STEP:
+                    run(m_pck[0], out);
+                    break;
+                case TX_PCK::METRIC:
+                    out.push_back(static_cast<uint8_t>(RX_PCK::METRIC));
+                    out.push_back(m_pck[0]);
+                    out.push_back(metric(m_pck[0]));
+                    break;
+                case TX_PCK::METRIC_ALL:
+                {
+                    // all counters restart when latched
+                    out.push_back(static_cast<uint8_t>(RX_PCK::METRIC_ALL));
+                    for(int b = 24; b >= 0; b -= 8) out.push_back(m_spk_cnt >> b);
+                    for(int b = 24; b >= 0; b -= 8) out.push_back(m_acc_cnt >> b);
+                    out.insert(out.end(), 6, 0);
+                    m_spk_cnt = 0;
+                    m_acc_cnt = 0;
+                    break;
+                }
+                case TX_PCK::CLEAR_ACT:
+                    clear_activity();
+                    out.push_back(static_cast<uint8_t>(RX_PCK::CLEAR_ACK));
+                    break;
+                case TX_PCK::CLEAR_CFG:
+                    clear_config();
+                    out.push_back(static_cast<uint8_t>(RX_PCK::CLEAR_ACK));
+                    break;
+                case TX_PCK::CFG_N:
+                {
+                    NeuronConfig n;
+                    n.addr      = m_pck[0];
+                    n.threshold = m_pck[1];
+                    n.delay     = m_pck[2] >> 4;
+                    n.output    = (m_pck[2] >> 3) & 1;
+                    n.leak      = m_pck[2] & 0x07;
+                    n.first_syn = ((m_pck[3] & 0x0F) << 8) | m_pck[4];
+                    n.syn_cnt   = m_pck[5];
+                    configure(n);
+                    out.push_back(static_cast<uint8_t>(RX_PCK::CFG_ACK));
+                    break;
+                }
+                case TX_PCK::CFG_SYNS:
+                {
+                    // header only, the synapses follow as weight & target pairs
+                    uint16_t start = ((m_pck[0] & 0x0F) << 8) | m_pck[1];
+                    uint16_t end   = ((m_pck[2] & 0x0F) << 8) | m_pck[3];
+                    m_syns_addr = start;
+                    m_syns_left = ((end - start) & 0x0FFF) + 1;
+                    m_pck_len   = 0;
+                    break;
+                }
+                case TX_PCK::FIRES:
+                    // header only, the fires follow as id & value pairs
+                    m_fires_left = m_pck[0];
+                    m_pck_len    = 0;
+                    break;
+                case TX_PCK::FIRE_MAP:
+                    // header only, the bitmap bytes follow
+                    m_map_value = m_pck[0];
+                    m_map_base  = m_pck[1];
+                    m_map_left  = m_pck[2];
+                    break;
+                case TX_PCK::CFG_SYN:
+                {
+                    SynapseConfig s;
+                    s.addr   = ((m_pck[0] & 0x0F) << 8) | m_pck[1];
+                    s.weight = static_cast<int8_t>(m_pck[2]);
+                    s.target = m_pck[3];
+                    s.delay  = 0;
+                    configure(s);
+                    out.push_back(static_cast<uint8_t>(RX_PCK::CFG_ACK));
+                    break;
+                }
+                default:
+                    // NOOP & unknown opcodes are dropped
+                    break;
+            }
+        }
+
+        /* One weight & target pair of a range, acked after the last one */
+        void configure_range_pair(std::vector<uint8_t> &out)
+        {
+            SynapseConfig s;
+            s.addr   = m_syns_addr;
+            s.weight = static_cast<int8_t>(m_pck[0]);
+            s.target = m_pck[1];
+            s.delay  = 0;
+            configure(s);
+
+            m_syns_addr = (m_syns_addr + 1) & 0x0FFF;
+            if(--m_syns_left == 0)
+                out.push_back(static_cast<uint8_t>(RX_PCK::CFG_ACK));
+        }
+
+        void accumulate(uint8_t target, int16_t value)
+        {
+            // the dendrite accumulator is 16 bits and wraps
+            m_dend[target] = static_cast<int16_t>(static_cast<uint16_t>(m_dend[target]) + value);
+            m_dend_active |= (1 << (target >> 4));
+            m_acc_cnt++;
+        }
+
+        void time_update(std::vector<uint8_t> &out)
+        {
+            out.push_back(static_cast<uint8_t>(RX_PCK::TIME_UPD));
+            out.push_back(m_time >> 24);
+            out.push_back(m_time >> 16);
+            out.push_back(m_time >> 8);
+            out.push_back(m_time);
+        }
+
+        /* Simulate one time step. Returns true if a time update was sent. */
+        bool step(std::vector<uint8_t> &out)
+        {
+            m_time++;
+
+            // Dendrite flush -> neuron: every neuron in an active group of 16
+            // is evaluated in ascending order, matching the RTL fire order.
+            uint16_t groups = m_dend_active;
+            m_dend_active = 0;
+            m_fired.clear();
+
+            bool sent_time = false;
+            while(groups)
+            {
+                int g = __builtin_ctz(groups);
+                groups &= groups - 1;
+
+                for(int n = g * 16; n < g * 16 + 16; ++n)
+                {
+                    int32_t accum = static_cast<int32_t>(m_charge[n]) + m_dend[n];
+                    m_dend[n] = 0;
+
+                    if(accum > m_threshold[n])
+                    {
+                        m_charge[n] = 0;
+                        m_fired.push_back(n);
+                        m_spk_cnt++;
+
+                        if(m_flags[n] & 0x08)
+                        {
+                            if(!sent_time)
+                            {
+                                time_update(out);
+                                sent_time = true;
+                            }
+                            out.push_back(static_cast<uint8_t>(RX_PCK::FIRE));
+                            out.push_back(n);
+                        }
+                    }
+                    else if(accum < -32768) m_charge[n] = -32768;
+                    else if(accum > 32767)  m_charge[n] = 32767;
+                    else                    m_charge[n] = accum;
+                }
+            }
+
+            // Axon: delayed spikes due this step, then undelayed fires
+            uint64_t *due = m_delayed[m_time % DELAY_SLOTS];
+            for(int w = 0; w < NUM_NEURONS / 64; ++w)
+            {
+                uint64_t bits = due[w];
+                due[w] = 0;
+
+                while(bits)
+                {
+                    dispatch(w * 64 + __builtin_ctzll(bits));
+                    bits &= bits - 1;
+                }
+            }
+
+            for(uint8_t n : m_fired)
+            {
+                uint8_t d = m_delay[n];
+
+                if(d == 0)
+                {
+                    dispatch(n);
+                }
+                else
+                {
+                    uint64_t *slot = m_delayed[(m_time + d) % DELAY_SLOTS];
+                    slot[n >> 6] |= (1ULL << (n & 63));
+                }
+            }
+
+            return sent_time;
+        }
+
+        /* Fire dispatch -> synapses -> dendrite (for the next time step) */
+        void dispatch(uint8_t n)
+        {
+            uint16_t first = m_first_syn[n];
+            uint16_t cnt   = m_syn_cnt[n];
+
+            for(uint16_t i = 0; i < cnt; ++i)
+            {
+                const Synapse &s = m_syn[(first + i) & 0x0FFF];
+                accumulate(s.target, s.weight);
+            }
+        }
+
+        /* Neuron configuration (struct of arrays) */
+        uint8_t  m_threshold[NUM_NEURONS];
+        uint8_t  m_flags[NUM_NEURONS];      // [3] output enable, [2:0] leak
+        uint8_t  m_delay[NUM_NEURONS];
+        uint16_t m_first_syn[NUM_NEURONS];
+        uint8_t  m_syn_cnt[NUM_NEURONS];
+
+        /* Synapse configuration */
+        Synapse  m_syn[NUM_SYNAPSES];
+
+        /* Network state */
+        int16_t  m_charge[NUM_NEURONS];
+        int16_t  m_dend[NUM_NEURONS];
+        uint16_t m_dend_active;             // one bit per group of 16 neurons
+        uint64_t m_delayed[DELAY_SLOTS][NUM_NEURONS / 64];
+        std::vector<uint8_t> m_fired;
+
+        uint32_t m_time;
+        uint32_t m_target;
+        uint32_t m_spk_cnt;
+        uint32_t m_acc_cnt;
+
+        /* Packet decoder state */
+        uint8_t  m_opcode   = 0;
+        uint8_t  m_pck[8]   = {};
+        int      m_pck_len  = 0;
+        int      m_pck_need = 0;
+        uint16_t m_syns_addr = 0;
+        int      m_syns_left = 0;
+        int      m_fires_left = 0;
+        int      m_map_left  = 0;
+        uint8_t  m_map_base  = 0;
+        uint8_t  m_map_value = 0;
+};
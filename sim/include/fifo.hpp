@@ -1,23 +1,47 @@
 #pragma once
 
+#include "stall.hpp"
+
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <cstdint>
-#include <deque>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
 
+/* Non-owning view of a contiguous run of elements */
 template <typename T>
+struct Span
+{
+    Span(T *data_, size_t size_) : data(data_), size(size_) {}
+    Span(std::vector<typename std::remove_const<T>::type> &v) : data(v.data()), size(v.size()) {}
+
+    T      *data;
+    size_t  size;
+};
+
+/* Fixed capacity ring buffer standing in for the RX/TX FIFOs of the board.
+ * N must be a power of two; the default matches the 8x512 FIFOs in
+ * docs/ram_spec.md. The host side moves data in bulk with push/pop(Span)
+ * while eval() only touches the head and tail index once per cycle. The
+ * host end of the handshake is ready every cycle unless a StallModel is
+ * set. Once paced, elements must also cross the host link (see
+ * link.hpp): the design only sees input that has landed, and the host
+ * can only pop output that has landed. */
+template <typename T, size_t N = 512>
 class FakeFifo
 {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "FakeFifo capacity must be a power of two");
+
     public:
+        static constexpr size_t capacity = N;
+
         /* true = input to verilog, false = output from verilog */
-        FakeFifo(uint8_t *clk_, uint8_t *rdy_, uint8_t *vld_, T *data_, bool dir_, bool rio_) :
-            m_dir(dir_), random_io(rio_), clk(clk_), rdy(rdy_), vld(vld_), data_port(data_)
+        FakeFifo(uint8_t *clk_, uint8_t *rdy_, uint8_t *vld_, T *data_, bool dir_) :
+            m_dir(dir_), clk(clk_), rdy(rdy_), vld(vld_), data_port(data_)
         {
-            fifo_empty = true;
-            fifo_full  = false;
-            last_flag  = false;
-
             if(m_dir)
             {
                 *data_port = 0;
@@ -31,66 +55,136 @@ class FakeFifo
 
         void push(T data)
         {
-            m_data.push_back(data);
+            if(full()) throw std::runtime_error("Cannot push when full");
+            m_buf[m_tail & MASK] = data;
+            m_tail++;
         }
 
-        void push_vec(std::vector<T> data)
+        T pop()
         {
-            for(auto &d : data) push(d);
+            if(landed() == 0) throw std::runtime_error("Cannot pop when empty");
+            if(m_window) m_landed--;
+            T ret = m_buf[m_head & MASK];
+            m_head++;
+            return ret;
         }
 
-        T pop()
+        /* Copy in as much of 'data' as fits. Returns the number of elements pushed. */
+        size_t push(Span<const T> data)
         {
-            if(empty()) throw std::runtime_error("Cannot pop when empty");
-            T ret = m_data.front();
-            m_data.pop_front();
-            return ret;
+            size_t n     = std::min(data.size, space());
+            size_t start = m_tail & MASK;
+            size_t first = std::min(n, N - start);
+
+            std::memcpy(&m_buf[start], data.data, first * sizeof(T));
+            std::memcpy(&m_buf[0], data.data + first, (n - first) * sizeof(T));
+
+            m_tail += n;
+            return n;
         }
 
-        void push_from_file(const std::string &fname)
+        /* Copy out up to 'data.size' elements. Returns the number of elements popped. */
+        size_t pop(Span<T> data)
         {
-            std::ifstream file(fname);
-            char buf[sizeof(T)];
-            T *item = reinterpret_cast<T*>(buf);
+            size_t n     = std::min(data.size, landed());
+            size_t start = m_head & MASK;
+            size_t first = std::min(n, N - start);
 
-            while(!file.fail())
-            {
-                file.read(buf, sizeof(T));
-                if(file.eof()) break;
-                push(*item);
-            }
+            std::memcpy(data.data, &m_buf[start], first * sizeof(T));
+            std::memcpy(data.data + first, &m_buf[0], (n - first) * sizeof(T));
+
+            m_head += n;
+            if(m_window) m_landed -= n;
+            return n;
         }
 
-        void pop_to_file(const std::string &fname)
+        size_t push_vec(const std::vector<T> &data)
         {
-            T item;
-            char *buf = reinterpret_cast<char *>(&item);
-            std::ofstream file(fname);
+            return push(Span<const T>(data.data(), data.size()));
+        }
 
-            while(!empty())
-            {
-                item = pop();
-                file.write(buf, sizeof(T));
-            }
+        /* Append everything the host can pop to 'out', returns the count */
+        size_t pop_all(std::vector<T> &out)
+        {
+            size_t old = out.size();
+            out.resize(old + landed());
+            return pop(Span<T>(out.data() + old, out.size() - old));
+        }
+
+        /* Drop everything buffered */
+        void clear()
+        {
+            m_head   = m_tail;
+            m_landed = 0;
         }
 
         bool full() const
         {
-            //return fifo_full;
-            return m_data.size() >= max_size;
+            return size() >= N;
         }
 
         bool empty() const
         {
-            return m_data.empty();
+            return m_head == m_tail;
         }
 
         size_t size() const
         {
-            return m_data.size();
+            return m_tail - m_head;
+        }
+
+        size_t space() const
+        {
+            return N - size();
+        }
+
+        /* Record the cycle passed to eval() for every element that crosses
+         * the rdy/vld handshake, in stream order (nullptr = stop) */
+        void stamp(std::vector<uint64_t> *stamps)
+        {
+            m_stamps = stamps;
+        }
+
+        /* Only pass elements over once the host link lands them (window >
+         * 0). An output FIFO then also holds off the design while 'window'
+         * elements are waiting to cross, as the device side FIFO of the
+         * link is full. */
+        void pace(size_t window)
+        {
+            m_window = window;
+            m_landed = 0;
         }
 
-        void eval(uint8_t clk, uint8_t rst)
+        /* The host link moved 'n' more elements across */
+        void land(size_t n)
+        {
+            m_landed += n;
+        }
+
+        /* Elements the design may take (input) or the host may pop (output) */
+        size_t landed() const
+        {
+            return m_window ? m_landed : size();
+        }
+
+        /* Elements still to cross the host link */
+        size_t in_flight() const
+        {
+            return size() - landed();
+        }
+
+        /* Hold off the host end of the handshake as 'model' decides */
+        void stall(const StallModel &model)
+        {
+            m_stall = model;
+        }
+
+        /* Elements that crossed the handshake, and cycles the stall model
+         * held off a handshake the host could otherwise have made */
+        uint64_t transfers() const { return m_transfers; }
+        uint64_t stalls() const { return m_stalls; }
+
+        void eval(uint8_t clk, uint8_t rst, uint64_t cycle = 0)
         {
             if(rst)
             {
@@ -104,106 +198,57 @@ class FakeFifo
                     *rdy = false;
                 }
             }
-            else
+            else if(clk)
             {
-
-                if(clk)
+                // the link runs on its own schedule, data or not
+                bool held  = m_stall.active() && m_stall.stall();
+                bool ready = m_dir ? (landed() > 0) : (!full() && (!m_window || in_flight() < m_window));
+                if(ready && held)
                 {
-                    if(m_dir)
-                    {
-                        *vld = !empty();
-                    }
-                    else
-                    {
-                        *rdy = !full();
-                    }
-
-                    if(*rdy && *vld)
-                    {
-                        if(m_dir) *data_port = pop();
-                        else push(*data_port);
-                    }
+                    ready = false;
+                    m_stalls++;
                 }
 
-                /*
-                if(clk && *rdy && *vld)
+                if(m_dir)
                 {
-                    if(m_dir)
-                    {
-                        *data_port = pop();
-                    }
-                    else
-                    {
-                        push(*data_port);
-                    }
+                    *vld = ready;
                 }
                 else
                 {
-                    if(m_dir)
-                    {
-                        *vld = !empty();
-                    }
-                    else
-                    {
-                        if(m_data.size() >= max_size)
-                        {
-                            *rdy = false;
-                        }
-                        else
-                        {
-                            *rdy = true;
-
-                        }
-                    }
+                    *rdy = ready;
                 }
-                */
-            }
-        }
-
-#ifdef NOT_DEFD
-        void eval(uint8_t clk, uint8_t rst)
-        {
-            if(!rst && clk)
-            {
 
-                /* data is moved when rdy and vld are asserted */
                 if(*rdy && *vld)
                 {
-                    if(m_dir)
-                    {
-                        if(!fifo_empty) *data_port = pop();
-
-                        if(fifo_empty) last_flag = true;
-                        else           last_flag = false;
-                    }
-                    else
-                    {
-                        push(*data_port);
-                    }
-                }
+                    if(m_dir) *data_port = m_buf[m_head++ & MASK];
+                    else      m_buf[m_tail++ & MASK] = *data_port;
 
-                /* when fifo is empty & outputs to verilog, valid should be de-asserted */
-                if(empty()) fifo_empty = true;
-                else        fifo_empty = false;
+                    if(m_dir && m_window) m_landed--;
 
-                if(!m_dir) *rdy = !fifo_full;
-                else       *vld = !last_flag || !fifo_empty;
+                    m_transfers++;
+                    if(m_stamps) m_stamps->push_back(cycle);
+                }
             }
         }
-#endif
 
     private:
-        /* our data queue */
-        std::deque<T> m_data;
+        static constexpr size_t MASK = N - 1;
 
-        const int max_size = 512;
+        /* our data queue -- head/tail are free running, masked on access */
+        T      m_buf[N];
+        size_t m_head = 0;
+        size_t m_tail = 0;
 
         /* true = input to verilog, false = output from verilog */
         bool    m_dir;
-        bool    random_io;
-        uint8_t fifo_full;
-        uint8_t fifo_empty;
-        uint8_t last_flag;
+
+        StallModel m_stall;
+        size_t     m_window = 0;            // 0 = not paced by a host link
+        size_t     m_landed = 0;
+        uint64_t   m_transfers = 0;
+        uint64_t   m_stalls    = 0;
+
+        std::vector<uint64_t> *m_stamps = nullptr;
 
         /* pointers into verilator obj */
         uint8_t *clk;
@@ -212,4 +257,24 @@ class FakeFifo
         T *data_port;
 };
 
+/* Whole-file helpers for the host side of a FakeFifo */
+template <typename T>
+std::vector<T> read_file(const std::string &fname)
+{
+    std::ifstream file(fname, std::ios::binary | std::ios::ate);
+    if(!file) throw std::runtime_error("Cannot open " + fname);
+
+    std::vector<T> data(file.tellg() / sizeof(T));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(data.data()), data.size() * sizeof(T));
+    return data;
+}
+
+template <typename T>
+void write_file(const std::string &fname, const std::vector<T> &data)
+{
+    std::ofstream file(fname, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(T));
+}
+
 typedef FakeFifo<uint8_t> ByteFifo;
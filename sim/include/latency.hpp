@@ -0,0 +1,230 @@
+#pragma once
+
+/* Input to output latency of the uCaspian packet stream
+ *
+ * Given the cycle every input byte was accepted by the design and every
+ * output byte was emitted (see FakeFifo::stamp), LatencyProfile matches
+ * each Input Fire and Simulate packet with the responses it causes:
+ *
+ *   STEP n   sent with the host target at P: the TIME_UPD reporting P + n,
+ *            and the first output FIRE of times P + 1 .. P + n
+ *   FIRE     sent with the host target at P, integrated in the step to
+ *            P + 1: the first TIME_UPD of P + 1 or later, and the first
+ *            output FIRE of time P + 1
+ *
+ * Every input of an Input Fires / Input Fire Bitmap packet is a FIRE
+ * sample of its own, sent with the pair or bitmap byte that carries it.
+ * Latencies count cycles from the last byte of the input packet (or pair,
+ * or bitmap byte) to the last byte of the response. Clear Activity / Clear Configuration reset
+ * the target to 0 and start a new epoch; responses are only matched
+ * within the epoch of their packet (counted by CLEAR_ACKs on the output).
+ */
+
+#include "packets.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct LatencySample
+{
+    size_t   offset;        // of the packet in the input stream
+    TX_PCK   type;          // FIRE or STEP
+    uint8_t  arg;           // input id or number of steps
+    uint32_t time;          // first network time the packet affects
+    uint64_t cycle;         // input packet accepted
+    int64_t  time_upd;      // cycles until its TIME_UPD, -1 if none
+    int64_t  fire;          // cycles until its first output FIRE, -1 if none
+};
+
+class LatencyProfile
+{
+    public:
+        /* in_stamps[i] / out_stamps[i]: cycle input / output byte i crossed
+         * the handshake. Input bytes never accepted have no stamp. */
+        LatencyProfile(const std::vector<uint8_t> &input, const std::vector<uint64_t> &in_stamps,
+                       const std::vector<uint8_t> &output, const std::vector<uint64_t> &out_stamps)
+        {
+            decode_output(output, out_stamps);
+            match_input(input, in_stamps);
+        }
+
+        const std::vector<LatencySample> &samples() const { return m_samples; }
+
+        /* Per event CSV: offset,type,arg,time,cycle,time_upd,fire */
+        void write_csv(const std::string &fname) const
+        {
+            std::ofstream file(fname);
+            if(!file) throw std::runtime_error("Cannot open " + fname);
+
+            file << "offset,type,arg,time,cycle,time_upd_latency,fire_latency\n";
+            for(const LatencySample &s : m_samples)
+            {
+                file << s.offset << ',' << (s.type == TX_PCK::FIRE ? "fire" : "step") << ','
+                     << int(s.arg) << ',' << s.time << ',' << s.cycle << ',';
+                if(s.time_upd >= 0) file << s.time_upd;
+                file << ',';
+                if(s.fire >= 0) file << s.fire;
+                file << '\n';
+            }
+        }
+
+        /* Percentile table of the four latencies */
+        void report(std::ostream &os) const
+        {
+            char line[128];
+            snprintf(line, sizeof(line), "%-20s %8s %8s %8s %8s %8s %8s %8s", "Latency (cycles)",
+                     "count", "min", "p50", "p90", "p99", "max", "mean");
+            os << line << std::endl;
+            row(os, "FIRE -> TIME_UPD", TX_PCK::FIRE, &LatencySample::time_upd);
+            row(os, "FIRE -> FIRE",     TX_PCK::FIRE, &LatencySample::fire);
+            row(os, "STEP -> TIME_UPD", TX_PCK::STEP, &LatencySample::time_upd);
+            row(os, "STEP -> FIRE",     TX_PCK::STEP, &LatencySample::fire);
+        }
+
+    private:
+        struct Response
+        {
+            RX_PCK   type;
+            uint32_t time;
+            uint64_t cycle;
+            int      epoch;
+        };
+
+        void decode_output(const std::vector<uint8_t> &output, const std::vector<uint64_t> &stamps)
+        {
+            RxDecoder rx;
+            int epoch = 0;
+            size_t n = std::min(output.size(), stamps.size());
+
+            for(size_t i = 0; i < n; ++i)
+            {
+                rx.feed(&output[i], 1, [&](const RxEvent &ev) {
+                    if(ev.type == RX_PCK::CLEAR_ACK) epoch++;
+                    else if(ev.type == RX_PCK::TIME_UPD || ev.type == RX_PCK::FIRE)
+                        m_responses.push_back({ev.type, ev.time, stamps[i], epoch});
+                });
+            }
+        }
+
+        void match_input(const std::vector<uint8_t> &input, const std::vector<uint64_t> &stamps)
+        {
+            uint32_t target = 0;
+            int      epoch  = 0;
+            size_t   pos    = 0;
+
+            while(pos < input.size())
+            {
+                size_t size = tx_packet_size(&input[pos], input.size() - pos);
+                if(size == 0 || pos + size > stamps.size()) break;
+
+                uint8_t  op    = input[pos];
+                uint64_t cycle = stamps[pos + size - 1];
+
+                if(op & 0x80)
+                {
+                    add_fire(pos, op & 0x7F, target, cycle, epoch);
+                }
+                else if(op == opcode(TX_PCK::FIRES))
+                {
+                    for(size_t i = 0; i < input[pos + 1]; ++i)
+                        add_fire(pos, input[pos + 2 + 2 * i], target, stamps[pos + 3 + 2 * i], epoch);
+                }
+                else if(op == opcode(TX_PCK::FIRE_MAP))
+                {
+                    for(size_t j = 0; j < input[pos + 3]; ++j)
+                    {
+                        for(int b = 0; b < 8; ++b)
+                        {
+                            if(input[pos + 4 + j] & (1 << b))
+                                add_fire(pos, input[pos + 2] + 8 * j + b, target, stamps[pos + 4 + j], epoch);
+                        }
+                    }
+                }
+                else if(op == opcode(TX_PCK::STEP))
+                {
+                    uint8_t steps = input[pos + 1];
+                    LatencySample s = {pos, TX_PCK::STEP, steps, target + 1, cycle, -1, -1};
+                    if(steps > 0)
+                    {
+                        s.time_upd = find(cycle, epoch, RX_PCK::TIME_UPD, target + steps, target + steps);
+                        s.fire     = find(cycle, epoch, RX_PCK::FIRE, target + 1, target + steps);
+                    }
+                    target += steps;
+                    m_samples.push_back(s);
+                }
+                else if(op == opcode(TX_PCK::CLEAR_ACT) || op == opcode(TX_PCK::CLEAR_CFG))
+                {
+                    target = 0;
+                    epoch++;
+                }
+
+                pos += size;
+            }
+        }
+
+        /* Input fire of 'id' accepted at 'cycle' with the host target at 'target' */
+        void add_fire(size_t offset, uint8_t id, uint32_t target, uint64_t cycle, int epoch)
+        {
+            LatencySample s = {offset, TX_PCK::FIRE, id, target + 1, cycle, -1, -1};
+            s.time_upd = find(cycle, epoch, RX_PCK::TIME_UPD, target + 1, UINT32_MAX);
+            s.fire     = find(cycle, epoch, RX_PCK::FIRE, target + 1, target + 1);
+            m_samples.push_back(s);
+        }
+
+        /* Cycles from 'cycle' to the first response of 'type' in 'epoch'
+         * with a time in [lo, hi] emitted after it, -1 if there is none */
+        int64_t find(uint64_t cycle, int epoch, RX_PCK type, uint32_t lo, uint32_t hi) const
+        {
+            auto it = std::upper_bound(m_responses.begin(), m_responses.end(), cycle,
+                                       [](uint64_t c, const Response &r) { return c < r.cycle; });
+
+            for(; it != m_responses.end() && it->epoch <= epoch; ++it)
+            {
+                if(it->epoch == epoch && it->type == type && it->time >= lo && it->time <= hi)
+                    return it->cycle - cycle;
+
+                // responses are in time order within an epoch
+                if(it->epoch == epoch && it->time > hi) break;
+            }
+
+            return -1;
+        }
+
+        void row(std::ostream &os, const char *name, TX_PCK type, int64_t LatencySample::*field) const
+        {
+            std::vector<int64_t> v;
+            for(const LatencySample &s : m_samples)
+            {
+                if(s.type == type && s.*field >= 0) v.push_back(s.*field);
+            }
+
+            char line[128];
+            if(v.empty())
+            {
+                snprintf(line, sizeof(line), "%-20s %8d", name, 0);
+                os << line << std::endl;
+                return;
+            }
+
+            std::sort(v.begin(), v.end());
+            // nearest rank
+            auto pct = [&](size_t p) { return v[std::max<size_t>(1, (v.size() * p + 99) / 100) - 1]; };
+
+            double sum = 0;
+            for(int64_t x : v) sum += x;
+
+            snprintf(line, sizeof(line), "%-20s %8zu %8lld %8lld %8lld %8lld %8lld %8.1f", name, v.size(),
+                     (long long)v.front(), (long long)pct(50), (long long)pct(90), (long long)pct(99),
+                     (long long)v.back(), sum / v.size());
+            os << line << std::endl;
+        }
+
+        std::vector<Response>      m_responses;
+        std::vector<LatencySample> m_samples;
+};
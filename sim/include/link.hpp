@@ -0,0 +1,229 @@
+#pragma once
+
+/* Host link timing for the simulator FIFOs
+ *
+ * An ideal FakeFifo moves a byte every cycle. LinkTiming paces both FIFOs
+ * at the rate the bytes would cross the link of a board, so the cycle
+ * count of a run becomes a wall clock estimate for that board:
+ *
+ *   ideal                      a byte per cycle (the default)
+ *   uart:baud                  8-N-1 serial, 10 bit times per byte in
+ *                              each direction, no flow control
+ *   spi:sck_hz(:depth(:gap_ns)) spi_v4 XFER frames from the Pico bridge
+ *
+ * and presets for the top levels in syn/top at the 24 MHz system clock:
+ *
+ *   upduino_uart_top           uart:3000000 (ip/osresearch, clk_sys / 8)
+ *   upduinolp_top              uart:1000000 (ip/uart, PRESCALER 24)
+ *   upduino_spi_top            spi:20833333:16:2000
+ *
+ * The SPI model follows fpga_link_task in serial_spi_passthrough: back to
+ * back XFER frames of 3 + max(wlen, rlen) bytes, separated by 'gap_ns' of
+ * chip select and loop overhead. wlen / rlen are sized from the status of
+ * the previous frame, taken as the frame starts (write FIFO space of the
+ * 'depth' entry device FIFO, bytes in the read FIFO), so every frame also
+ * polls the status and a byte takes at least one frame to be noticed. The
+ * Pico asks for 30 MHz, which its divider rounds down to 125 MHz / 6.
+ */
+
+#include "fifo.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class LinkTiming
+{
+    public:
+        enum class Kind { IDEAL, UART, SPI };
+
+        static constexpr uint64_t SYS_CLK_HZ = 24000000;
+
+        LinkTiming() {}
+
+        /* Build a link from its description for a system clock of
+         * 'clk_hz'. Throws on an unknown link or out of range arguments. */
+        static LinkTiming parse(const std::string &spec, uint64_t clk_hz = SYS_CLK_HZ)
+        {
+            if(spec == "upduino_uart_top") return parse("uart:3000000", clk_hz);
+            if(spec == "upduinolp_top")    return parse("uart:1000000", clk_hz);
+            if(spec == "upduino_spi_top")  return parse("spi:20833333:16:2000", clk_hz);
+
+            std::vector<std::string> f;
+            size_t pos = 0;
+            while(true)
+            {
+                size_t colon = spec.find(':', pos);
+                f.push_back(spec.substr(pos, colon - pos));
+                if(colon == std::string::npos) break;
+                pos = colon + 1;
+            }
+
+            auto bad = [&]() { return std::runtime_error("Invalid host link '" + spec + "'"); };
+            auto num = [&](const std::string &s) {
+                char *end;
+                unsigned long long v = strtoull(s.c_str(), &end, 0);
+                if(s.empty() || *end != '\0') throw bad();
+                return uint64_t(v);
+            };
+
+            LinkTiming l;
+            l.m_clk_hz = clk_hz;
+
+            if(f[0] == "ideal" && f.size() == 1)
+            {
+                l.m_kind = Kind::IDEAL;
+            }
+            else if(f[0] == "uart" && f.size() == 2)
+            {
+                l.m_kind    = Kind::UART;
+                l.m_bit_hz  = num(f[1]);
+                l.m_depth   = ByteFifo::capacity;
+            }
+            else if(f[0] == "spi" && f.size() >= 2 && f.size() <= 4)
+            {
+                l.m_kind   = Kind::SPI;
+                l.m_bit_hz = num(f[1]);
+                l.m_depth  = (f.size() >= 3) ? num(f[2]) : 16;
+                l.m_gap    = ((f.size() >= 4) ? num(f[3]) : 2000) * clk_hz / 1000000000;
+                if(l.m_depth < 1 || l.m_depth > 255) throw bad();
+            }
+            else
+            {
+                throw bad();
+            }
+
+            // at most one bit per system clock
+            if(l.m_kind != Kind::IDEAL && (l.m_bit_hz == 0 || l.m_bit_hz > clk_hz)) throw bad();
+
+            return l;
+        }
+
+        bool active() const { return m_kind != Kind::IDEAL; }
+
+        /* System clock the link rates are relative to */
+        uint64_t clock_hz() const { return m_clk_hz; }
+
+        /* Pace the FIFOs by this link */
+        void attach(ByteFifo &in, ByteFifo &out)
+        {
+            in.pace(active() ? m_depth : 0);
+            out.pace(active() ? m_depth : 0);
+            restart();
+        }
+
+        /* Back to an idle line, e.g. after a reset */
+        void restart()
+        {
+            m_rx = Serial();
+            m_tx = Serial();
+            m_frame = Serial();
+            m_in_frame = false;
+            m_gap_left = 0;
+            m_avail = m_count = 0;
+        }
+
+        /* Call once per clock cycle, after the FIFOs */
+        void eval(ByteFifo &in, ByteFifo &out)
+        {
+            if(m_kind == Kind::UART)
+            {
+                // the line idles until a byte is waiting, then one start,
+                // eight data, and one stop bit
+                if(in.in_flight() == 0) m_rx = Serial();
+                else if(m_rx.step(m_bit_hz, m_clk_hz, 10)) in.land(1);
+
+                if(out.in_flight() == 0) m_tx = Serial();
+                else if(m_tx.step(m_bit_hz, m_clk_hz, 10)) out.land(1);
+            }
+            else if(m_kind == Kind::SPI)
+            {
+                eval_spi(in, out);
+            }
+        }
+
+    private:
+        /* Bit clock divided down from the system clock */
+        struct Serial
+        {
+            uint64_t acc  = 0;
+            unsigned bits = 0;
+
+            /* Advance one cycle, true when a byte of 'per_byte' bits ends */
+            bool step(uint64_t bit_hz, uint64_t clk_hz, unsigned per_byte)
+            {
+                acc += bit_hz;
+                if(acc < clk_hz) return false;
+                acc -= clk_hz;
+                if(++bits < per_byte) return false;
+                bits = 0;
+                return true;
+            }
+        };
+
+        void eval_spi(ByteFifo &in, ByteFifo &out)
+        {
+            if(m_gap_left > 0)
+            {
+                m_gap_left--;
+                return;
+            }
+
+            if(!m_in_frame)
+            {
+                m_wlen  = std::min<size_t>(m_avail, in.in_flight());
+                m_rlen  = m_count;
+                m_len   = 3 + std::max(m_wlen, m_rlen);
+                m_byte  = 0;
+                m_frame = Serial();
+                m_in_frame = true;
+            }
+
+            if(!m_frame.step(m_bit_hz, m_clk_hz, 8)) return;
+
+            size_t k = m_byte++;
+            if(k == 0)
+            {
+                // MISO: write FIFO space, then read FIFO count
+                m_status_avail = m_depth - std::min<size_t>(m_depth, in.landed());
+            }
+            else if(k == 1)
+            {
+                m_status_count = std::min<size_t>(m_depth, out.in_flight());
+            }
+            else if(k >= 3)
+            {
+                if(k - 3 < m_wlen) in.land(1);
+                if(k - 3 < m_rlen && out.in_flight() > 0) out.land(1);
+            }
+
+            if(m_byte == m_len)
+            {
+                // status from the start of this frame, less what it moved
+                m_avail    = m_status_avail - std::min(m_status_avail, m_wlen);
+                m_count    = m_status_count - std::min(m_status_count, m_rlen);
+                m_in_frame = false;
+                m_gap_left = m_gap;
+            }
+        }
+
+        Kind     m_kind   = Kind::IDEAL;
+        uint64_t m_clk_hz = SYS_CLK_HZ;
+        uint64_t m_bit_hz = 0;
+        size_t   m_depth  = 0;          // device side FIFO of the link
+        uint64_t m_gap    = 0;          // SPI cycles between frames
+
+        // UART, one line per direction
+        Serial   m_rx, m_tx;
+
+        // SPI frame in progress
+        Serial   m_frame;
+        bool     m_in_frame = false;
+        uint64_t m_gap_left = 0;
+        size_t   m_wlen = 0, m_rlen = 0, m_len = 0, m_byte = 0;
+        size_t   m_status_avail = 0, m_status_count = 0;
+        size_t   m_avail = 0, m_count = 0;   // status for the next frame
+};
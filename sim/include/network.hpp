@@ -0,0 +1,233 @@
+#pragma once
+
+/* uCaspian network description & configuration compiler
+ *
+ * A Network is a list of neurons and synapses as written by the user. It is
+ * compiled into the device layout -- each neuron's outgoing synapses get a
+ * contiguous range of synapse RAM (first_syn, syn_cnt as stored by axon.sv)
+ * -- and encoded into the shortest host -> uCaspian packet stream.
+ *
+ * Text format, one entry per line ('#' starts a comment):
+ *   N addr threshold (leak) (delay) (output)   configure a neuron
+ *   S from to weight                           add a synapse
+ *   I id value                                 input fire, after configuration
+ *   R steps                                    run, after configuration
+ * leak is the signed leak value (-1 to 4), as in scripts/test_func.py.
+ */
+
+#include "packets.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct Network
+{
+    struct Neuron
+    {
+        uint8_t addr;
+        uint8_t threshold;
+        int     leak;
+        uint8_t delay;
+        bool    output;
+    };
+
+    struct Synapse
+    {
+        uint8_t from;
+        uint8_t to;
+        int8_t  weight;
+    };
+
+    std::vector<Neuron>  neurons;
+    std::vector<Synapse> synapses;
+
+    // packets appended after the configuration (input fires & runs)
+    std::vector<uint8_t> commands;
+};
+
+/* Network as stored in device RAM */
+struct Layout
+{
+    std::vector<NeuronConfig>  neurons;   // ascending address
+    std::vector<SynapseConfig> synapses;  // ascending address
+};
+
+inline Network read_network(const std::string &fname)
+{
+    std::ifstream file(fname);
+    if(!file) throw std::runtime_error("Cannot open " + fname);
+
+    Network net;
+    std::string line;
+    int line_no = 0;
+
+    while(std::getline(file, line))
+    {
+        line_no++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string type;
+        if(!(fields >> type)) continue;
+
+        auto fail = [&]() {
+            return std::runtime_error(fname + ":" + std::to_string(line_no) + ": bad entry '" + line + "'");
+        };
+
+        if(type == "N")
+        {
+            int addr, threshold, leak = -1, delay = 0, output = 0;
+            if(!(fields >> addr >> threshold)) throw fail();
+            fields >> leak >> delay >> output;
+
+            if(addr < 0 || addr > 255 || threshold < 0 || threshold > 255 ||
+               leak < -1 || leak > 4 || delay < 0 || delay > 15) throw fail();
+
+            net.neurons.push_back({uint8_t(addr), uint8_t(threshold), leak, uint8_t(delay), output != 0});
+        }
+        else if(type == "S")
+        {
+            int from, to, weight;
+            if(!(fields >> from >> to >> weight)) throw fail();
+
+            if(from < 0 || from > 255 || to < 0 || to > 255 || weight < -128 || weight > 127) throw fail();
+
+            net.synapses.push_back({uint8_t(from), uint8_t(to), int8_t(weight)});
+        }
+        else if(type == "I")
+        {
+            int id, value;
+            if(!(fields >> id >> value) || id < 0 || id > 127 || value < 0 || value > 255) throw fail();
+
+            uint8_t buf[TX_FIRE_SIZE];
+            net.commands.insert(net.commands.end(), buf, buf + tx_input_fire(buf, id, value));
+        }
+        else if(type == "R")
+        {
+            long steps;
+            if(!(fields >> steps) || steps < 0) throw fail();
+
+            // one STEP packet advances at most 255 steps
+            for(; steps > 0; steps -= 255)
+            {
+                uint8_t buf[TX_STEP_SIZE];
+                net.commands.insert(net.commands.end(), buf, buf + tx_step(buf, std::min(steps, 255L)));
+            }
+        }
+        else
+        {
+            throw fail();
+        }
+    }
+
+    return net;
+}
+
+/* Assign each neuron a contiguous synapse range, in neuron address order */
+inline Layout compile_network(const Network &net)
+{
+    Layout layout;
+    std::vector<int> index(256, -1);
+
+    for(const Network::Neuron &n : net.neurons)
+    {
+        if(index[n.addr] >= 0)
+            throw std::runtime_error("Neuron " + std::to_string(n.addr) + " configured twice");
+
+        index[n.addr] = 0;
+    }
+
+    std::vector<Network::Neuron> neurons = net.neurons;
+    std::sort(neurons.begin(), neurons.end(),
+              [](const Network::Neuron &a, const Network::Neuron &b) { return a.addr < b.addr; });
+
+    for(size_t i = 0; i < neurons.size(); ++i)
+    {
+        const Network::Neuron &n = neurons[i];
+        index[n.addr] = i;
+
+        NeuronConfig cfg;
+        cfg.addr      = n.addr;
+        cfg.threshold = n.threshold;
+        cfg.output    = n.output;
+        cfg.leak      = n.leak + 1;
+        cfg.delay     = n.delay;
+        cfg.first_syn = 0;
+        cfg.syn_cnt   = 0;
+        layout.neurons.push_back(cfg);
+    }
+
+    // group synapses by source neuron, keeping their order within a neuron
+    std::vector<std::vector<const Network::Synapse *>> fan_out(neurons.size());
+    for(const Network::Synapse &s : net.synapses)
+    {
+        if(index[s.from] < 0)
+            throw std::runtime_error("Synapse from unconfigured neuron " + std::to_string(s.from));
+
+        fan_out[index[s.from]].push_back(&s);
+    }
+
+    uint16_t addr = 0;
+    for(size_t i = 0; i < neurons.size(); ++i)
+    {
+        if(fan_out[i].size() > 255)
+            throw std::runtime_error("Neuron " + std::to_string(neurons[i].addr) + " has more than 255 synapses");
+
+        if(addr + fan_out[i].size() > 4096)
+            throw std::runtime_error("Network has more than 4096 synapses");
+
+        layout.neurons[i].first_syn = fan_out[i].empty() ? 0 : addr;
+        layout.neurons[i].syn_cnt   = fan_out[i].size();
+
+        for(const Network::Synapse *s : fan_out[i])
+            layout.synapses.push_back({addr++, s->weight, s->to, 0});
+    }
+
+    return layout;
+}
+
+/* Encode synapses (sorted by address) using Configure Synapses range
+ * packets for every run of consecutive addresses. A range costs 5 + 2n
+ * bytes against 5n for single packets, so any run of 2 or more wins. */
+inline void encode_synapses(const SynapseConfig *syns, size_t count, std::vector<uint8_t> &out)
+{
+    size_t i = 0;
+    while(i < count)
+    {
+        size_t run = 1;
+        while(i + run < count && run < TX_CFG_SYNS_MAX && syns[i + run].addr == syns[i].addr + run)
+            run++;
+
+        size_t old = out.size();
+        if(run == 1)
+        {
+            out.resize(old + TX_CFG_SYN_SIZE);
+            tx_cfg_synapse(&out[old], syns[i]);
+        }
+        else
+        {
+            out.resize(old + tx_cfg_synapses_size(run));
+            tx_cfg_synapses(&out[old], syns[i].addr, &syns[i], run);
+        }
+
+        i += run;
+    }
+}
+
+/* Encode a complete configuration: neurons, then synapses */
+inline void encode_layout(const Layout &layout, std::vector<uint8_t> &out)
+{
+    for(const NeuronConfig &n : layout.neurons)
+    {
+        size_t old = out.size();
+        out.resize(old + TX_CFG_N_SIZE);
+        tx_cfg_neuron(&out[old], n);
+    }
+
+    encode_synapses(layout.synapses.data(), layout.synapses.size(), out);
+}
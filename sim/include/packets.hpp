@@ -1,12 +1,23 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 
+/* uCaspian packet library
+ *
+ * Header-only encoders for host -> uCaspian packets and an incremental
+ * decoder for the uCaspian -> host stream. Encoders write directly into a
+ * caller provided buffer and return the number of bytes written; the
+ * decoder never allocates. See docs/packet_spec.md for the formats.
+ */
+
+// Opcodes match rtl/packet_interface.sv and docs/packet_spec.md
 enum class RX_PCK
 {
     NONE,
-    CFG_ACK    = 0x70,
-    CLEAR_ACK  = 0x0C,
+    CFG_ACK    = 0x18,
+    CLEAR_ACK  = 0x04,
     METRIC     = 0x02,
+    METRIC_ALL = 0x03,
     TIME_UPD   = 0x01,
     FIRE       = 0x80
 };
@@ -14,16 +25,119 @@ enum class RX_PCK
 enum class TX_PCK
 {
     NONE,
+    NOOP       = 0x00,
     FIRE       = 0x80,
     STEP       = 0x01,
     METRIC     = 0x02,
+    METRIC_ALL = 0x03,
     CLEAR_ACT  = 0x04,
-    CLEAR_CFG  = 0x08,
-    CFG_N      = 0x10,
-    CFG_SYN    = 0x20,
-    CFG_SYNS   = 0x40
+    CLEAR_CFG  = 0x05,
+    FIRES      = 0x06,
+    FIRE_MAP   = 0x07,
+    CFG_N      = 0x08,
+    CFG_SYN    = 0x10,
+    CFG_SYNS   = 0x11
+};
+
+constexpr uint8_t opcode(TX_PCK p) { return static_cast<uint8_t>(p); }
+constexpr uint8_t opcode(RX_PCK p) { return static_cast<uint8_t>(p); }
+
+/* Opcode tables: payload bytes following each opcode, -1 if the opcode is
+ * not defined in that direction */
+struct OpcodeTable
+{
+    int8_t payload[256];
+
+    constexpr int operator[](uint8_t op) const { return payload[op]; }
+    constexpr bool valid(uint8_t op) const { return payload[op] >= 0; }
 };
 
+constexpr OpcodeTable make_tx_table()
+{
+    OpcodeTable t = {};
+    for(int op = 0; op < 256; ++op) t.payload[op] = (op & 0x80) ? 1 : -1;
+
+    t.payload[opcode(TX_PCK::NOOP)]      = 0;
+    t.payload[opcode(TX_PCK::STEP)]      = 1;
+    t.payload[opcode(TX_PCK::METRIC)]    = 1;
+    t.payload[opcode(TX_PCK::METRIC_ALL)] = 0;
+    t.payload[opcode(TX_PCK::CLEAR_ACT)] = 0;
+    t.payload[opcode(TX_PCK::CLEAR_CFG)] = 0;
+    t.payload[opcode(TX_PCK::FIRES)]     = 1; // count header, see tx_packet_size
+    t.payload[opcode(TX_PCK::FIRE_MAP)]  = 3; // bitmap header, see tx_packet_size
+    t.payload[opcode(TX_PCK::CFG_N)]     = 6;
+    t.payload[opcode(TX_PCK::CFG_SYN)]   = 4;
+    t.payload[opcode(TX_PCK::CFG_SYNS)]  = 4; // range header, see tx_packet_size
+    return t;
+}
+
+constexpr OpcodeTable make_rx_table()
+{
+    OpcodeTable t = {};
+    for(int op = 0; op < 256; ++op) t.payload[op] = -1;
+
+    t.payload[opcode(RX_PCK::CFG_ACK)]   = 0;
+    t.payload[opcode(RX_PCK::CLEAR_ACK)] = 0;
+    t.payload[opcode(RX_PCK::METRIC)]    = 2;
+    t.payload[opcode(RX_PCK::METRIC_ALL)] = 14;
+    t.payload[opcode(RX_PCK::TIME_UPD)]  = 4;
+    t.payload[opcode(RX_PCK::FIRE)]      = 1;
+    return t;
+}
+
+constexpr OpcodeTable TX_OPCODES = make_tx_table();
+constexpr OpcodeTable RX_OPCODES = make_rx_table();
+
+// Number of bytes following a host -> uCaspian opcode (unknown opcodes are dropped by the RTL)
+constexpr int tx_payload_size(uint8_t op)
+{
+    return TX_OPCODES.valid(op) ? TX_OPCODES[op] : 0;
+}
+
+/* Size of the host -> uCaspian packet starting at buf[0], including the
+ * weight & target pairs of a Configure Synapses range and the body of an
+ * Input Fires / Input Fire Bitmap packet. Returns 0 if more than 'len'
+ * bytes are needed to tell. */
+inline size_t tx_packet_size(const uint8_t *buf, size_t len)
+{
+    if(len == 0) return 0;
+
+    switch(static_cast<TX_PCK>(buf[0]))
+    {
+        case TX_PCK::CFG_SYNS:
+        {
+            if(len < 5) return 0;
+            uint16_t start = ((buf[1] & 0x0F) << 8) | buf[2];
+            uint16_t end   = ((buf[3] & 0x0F) << 8) | buf[4];
+            return 5 + 2 * (((end - start) & 0x0FFF) + 1);
+        }
+        case TX_PCK::FIRES:
+            if(len < 2) return 0;
+            return 2 + 2 * size_t(buf[1]);
+        case TX_PCK::FIRE_MAP:
+            if(len < 4) return 0;
+            return 4 + size_t(buf[3]);
+        default:
+            return 1 + tx_payload_size(buf[0]);
+    }
+}
+
+/* Encoded packet sizes */
+constexpr int TX_FIRE_SIZE      = 2;
+constexpr int TX_STEP_SIZE      = 2;
+constexpr int TX_METRIC_SIZE    = 2;
+constexpr int TX_METRIC_ALL_SIZE = 1;
+constexpr int TX_CLEAR_SIZE     = 1;
+constexpr int TX_CFG_N_SIZE     = 7;
+constexpr int TX_CFG_SYN_SIZE   = 5;
+constexpr int TX_CFG_SYNS_MAX   = 4096;
+constexpr int TX_FIRES_MAX      = 255;
+constexpr int TX_FIRE_MAP_MAX   = 256;
+
+constexpr int tx_cfg_synapses_size(int count) { return 5 + 2 * count; }
+constexpr int tx_input_fires_size(int count) { return 2 + 2 * count; }
+constexpr int tx_input_fire_map_size(int count) { return 4 + (count + 7) / 8; }
+
 struct NeuronConfig
 {
     uint8_t  addr;
@@ -32,6 +146,13 @@ struct NeuronConfig
     uint8_t  leak;
     uint16_t first_syn;
     uint8_t  syn_cnt;
+    uint8_t  delay;     // axonal delay (0-15)
+};
+
+struct InputFire
+{
+    uint8_t  id;        // 0-255, unlike the 7 bit id of tx_input_fire
+    uint8_t  value;
 };
 
 struct SynapseConfig
@@ -39,63 +160,315 @@ struct SynapseConfig
     uint16_t addr;
     int8_t   weight;
     uint8_t  target;
-    uint8_t  delay;
+    uint8_t  delay;     // not sent, the RTL has no synaptic delay
 };
 
-int tx_input_fire(uint8_t *buf, uint8_t id, uint8_t value)
+inline int tx_noop(uint8_t *buf)
+{
+    buf[0] = opcode(TX_PCK::NOOP);
+    return 1;
+}
+
+inline int tx_input_fire(uint8_t *buf, uint8_t id, uint8_t value)
 {
-    buf[0] = TX_PCK::FIRE | (id & 127);
+    buf[0] = opcode(TX_PCK::FIRE) | (id & 127);
     buf[1] = value;
 
     // return number of bytes
-    return 2;
+    return TX_FIRE_SIZE;
+}
+
+/* Fire the inputs of fires[0..count) in one packet, count 0-255. buf must
+ * hold tx_input_fires_size(count). */
+inline int tx_input_fires(uint8_t *buf, const InputFire *fires, int count)
+{
+    buf[0] = opcode(TX_PCK::FIRES);
+    buf[1] = count;
+
+    uint8_t *p = buf + 2;
+    for(int i = 0; i < count; ++i)
+    {
+        *p++ = fires[i].id;
+        *p++ = fires[i].value;
+    }
+
+    return tx_input_fires_size(count);
 }
 
-int tx_step(uint8_t *buf, uint8_t steps)
+/* Fire inputs first + i (mod 256), for each fire[i] set (0 <= i < count),
+ * with 'value'. count 0-256, buf must hold tx_input_fire_map_size(count). */
+inline int tx_input_fire_map(uint8_t *buf, uint8_t value, uint8_t first, int count, const bool *fire)
 {
-    buf[0] = TX_PCK::STEP;
+    int bytes = (count + 7) / 8;
+
+    buf[0] = opcode(TX_PCK::FIRE_MAP);
+    buf[1] = value;
+    buf[2] = first;
+    buf[3] = bytes;
+
+    for(int i = 0; i < bytes; ++i) buf[4 + i] = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        if(fire[i]) buf[4 + i / 8] |= 1 << (i % 8);
+    }
+
+    return tx_input_fire_map_size(count);
+}
+
+inline int tx_step(uint8_t *buf, uint8_t steps)
+{
+    buf[0] = opcode(TX_PCK::STEP);
     buf[1] = steps;
-    return 2;
+    return TX_STEP_SIZE;
 }
 
-int tx_clear_act(uint8_t *buf)
+inline int tx_clear_act(uint8_t *buf)
 {
-    buf[0] = TX_PCK::CLEAR_ACT;
-    return 1;
+    buf[0] = opcode(TX_PCK::CLEAR_ACT);
+    return TX_CLEAR_SIZE;
 }
 
-int tx_clear_cfg(uint8_t *buf)
+inline int tx_clear_cfg(uint8_t *buf)
 {
-    buf[0] = TX_PCK::CLEAR_CFG;
-    return 1;
+    buf[0] = opcode(TX_PCK::CLEAR_CFG);
+    return TX_CLEAR_SIZE;
 }
 
-int tx_metric(uint8_t *buf, uint8_t metric)
+inline int tx_metric(uint8_t *buf, uint8_t metric)
 {
-    buf[0] = TX_PCK::METRIC;
+    buf[0] = opcode(TX_PCK::METRIC);
     buf[1] = metric;
-    return 2;
+    return TX_METRIC_SIZE;
+}
+
+/* Latch and read every metric counter in one METRIC_ALL response */
+inline int tx_metric_all(uint8_t *buf)
+{
+    buf[0] = opcode(TX_PCK::METRIC_ALL);
+    return TX_METRIC_ALL_SIZE;
 }
 
-int tx_cfg_neuron(uint8_t *buf, NeuronConfig &n)
+inline int tx_cfg_neuron(uint8_t *buf, const NeuronConfig &n)
 {
-    buf[0] = TX_PCK::CFG_N;
+    buf[0] = opcode(TX_PCK::CFG_N);
     buf[1] = n.addr;
     buf[2] = n.threshold;
-    buf[3] = (n.output << 3) | (n.leak & 0x07);
-    buf[4] = (n.first_syn >> 8);
+    buf[3] = (n.delay << 4) | (n.output << 3) | (n.leak & 0x07);
+    buf[4] = (n.first_syn >> 8) & 0x0F;
     buf[5] = (n.first_syn & 0xFF);
     buf[6] = n.syn_cnt;
-    return 7;
+    return TX_CFG_N_SIZE;
 }
 
-int tx_cfg_synapse(uint8_t *buf, SynapseConfig &s)
+inline int tx_cfg_synapse(uint8_t *buf, const SynapseConfig &s)
 {
-    buf[0] = TX_PCK::CFG_SYN;
-    buf[1] = (s.addr >> 8);
-    buf[2] = (s.addr & 0XFF);
+    buf[0] = opcode(TX_PCK::CFG_SYN);
+    buf[1] = (s.addr >> 8) & 0x0F;
+    buf[2] = (s.addr & 0xFF);
     buf[3] = s.weight;
     buf[4] = s.target;
-    buf[5] = s.delay;
-    return 6;
+    return TX_CFG_SYN_SIZE;
+}
+
+/* Configure 'count' (1-4096) consecutive synapses starting at 'start' from
+ * the weight & target of syns[0..count). The address of each SynapseConfig
+ * is implied by its position. buf must hold tx_cfg_synapses_size(count). */
+inline int tx_cfg_synapses(uint8_t *buf, uint16_t start, const SynapseConfig *syns, int count)
+{
+    uint16_t end = (start + count - 1) & 0x0FFF;
+
+    buf[0] = opcode(TX_PCK::CFG_SYNS);
+    buf[1] = (start >> 8) & 0x0F;
+    buf[2] = (start & 0xFF);
+    buf[3] = (end >> 8);
+    buf[4] = (end & 0xFF);
+
+    uint8_t *p = buf + 5;
+    for(int i = 0; i < count; ++i)
+    {
+        *p++ = syns[i].weight;
+        *p++ = syns[i].target;
+    }
+
+    return tx_cfg_synapses_size(count);
+}
+
+/* Bridge packets, expanded by the Pico passthrough into Input Fire packets
+ * for one timestep followed by a Simulate of 'steps' (none if 0). The RTL
+ * does not understand them. See "Bridge Packets" in docs/packet_spec.md. */
+enum class SEQ_PCK
+{
+    BITMAP     = 0x20,
+    RLE        = 0x21
+};
+
+constexpr uint8_t opcode(SEQ_PCK p) { return static_cast<uint8_t>(p); }
+
+constexpr int TX_SEQ_BITMAP_MAX = 5 + 16;      // 128 inputs
+constexpr int TX_SEQ_RLE_MAX    = 4 + 2 * 64;  // alternating inputs
+
+/* Fire inputs first + i, for each fire[i] set (0 <= i < count), with 'value' */
+inline int tx_seq_bitmap(uint8_t *buf, uint8_t value, uint8_t steps, uint8_t first, uint8_t count, const bool *fire)
+{
+    buf[0] = opcode(SEQ_PCK::BITMAP);
+    buf[1] = value;
+    buf[2] = steps;
+    buf[3] = first;
+    buf[4] = count;
+
+    int bytes = (count + 7) / 8;
+    for(int i = 0; i < bytes; ++i) buf[5 + i] = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        if(fire[i]) buf[5 + i / 8] |= 1 << (i % 8);
+    }
+
+    return 5 + bytes;
 }
+
+/* Fire the inputs ids[0..n) (ascending, < 128) with 'value' as runs */
+inline int tx_seq_rle(uint8_t *buf, uint8_t value, uint8_t steps, const uint8_t *ids, int n)
+{
+    buf[0] = opcode(SEQ_PCK::RLE);
+    buf[1] = value;
+    buf[2] = steps;
+
+    int runs = 0;
+    int next = 0;   // first input after the previous run
+    for(int i = 0; i < n; )
+    {
+        int len = 1;
+        while(i + len < n && ids[i + len] == ids[i] + len) len++;
+
+        buf[4 + 2 * runs] = ids[i] - next;
+        buf[5 + 2 * runs] = len;
+        runs++;
+
+        next = ids[i] + len;
+        i += len;
+    }
+
+    buf[3] = runs;
+    return 4 + 2 * runs;
+}
+
+/* Counters of a METRIC_ALL response, since the previous snapshot or clear */
+struct MetricSnapshot
+{
+    uint32_t spikes;
+    uint32_t accumulations;     // synaptic operations
+    uint64_t active_cycles;     // 48 bits (32 unless built with METRIC_CLK_48)
+};
+
+/* A decoded uCaspian -> host packet */
+struct RxEvent
+{
+    RX_PCK         type;
+    uint32_t       time;      // TIME_UPD: new time, FIRE: time of the last TIME_UPD
+    uint8_t        neuron;    // FIRE
+    uint8_t        addr;      // METRIC
+    uint8_t        value;     // METRIC, or the byte itself for NONE (unknown opcode)
+    MetricSnapshot metrics;   // METRIC_ALL
+};
+
+/* Incremental decoder for the uCaspian -> host byte stream. Bytes may be
+ * fed in chunks of any size; packets split across chunks are completed
+ * by later calls. Each complete packet is passed to 'on_event'. */
+class RxDecoder
+{
+    public:
+        template <typename F>
+        size_t feed(const uint8_t *buf, size_t len, F &&on_event)
+        {
+            for(size_t i = 0; i < len; ++i)
+            {
+                uint8_t byte = buf[i];
+
+                if(m_need == 0)
+                {
+                    m_opcode = byte;
+                    m_len    = 0;
+
+                    int need = RX_OPCODES[byte];
+                    if(need > 0)
+                    {
+                        m_need = need;
+                        continue;
+                    }
+                }
+                else
+                {
+                    m_pck[m_len++] = byte;
+                    if(m_len < m_need) continue;
+                    m_need = 0;
+                }
+
+                on_event(decode());
+            }
+
+            return len;
+        }
+
+        /* Time of the last TIME_UPD packet */
+        uint32_t time() const { return m_time; }
+
+        /* True if a packet has been started but not completed */
+        bool partial() const { return m_need != 0; }
+
+        void reset()
+        {
+            m_opcode = 0;
+            m_len    = 0;
+            m_need   = 0;
+            m_time   = 0;
+        }
+
+    private:
+        RxEvent decode()
+        {
+            RxEvent ev = {};
+            ev.type = RX_OPCODES.valid(m_opcode) ? static_cast<RX_PCK>(m_opcode) : RX_PCK::NONE;
+
+            switch(ev.type)
+            {
+                case RX_PCK::TIME_UPD:
+                    m_time = (uint32_t(m_pck[0]) << 24) | (uint32_t(m_pck[1]) << 16) |
+                             (uint32_t(m_pck[2]) << 8)  |  uint32_t(m_pck[3]);
+                    break;
+                case RX_PCK::FIRE:
+                    ev.neuron = m_pck[0];
+                    break;
+                case RX_PCK::METRIC:
+                    ev.addr  = m_pck[0];
+                    ev.value = m_pck[1];
+                    break;
+                case RX_PCK::METRIC_ALL:
+                    ev.metrics.spikes        = uint32_t(be(m_pck, 4));
+                    ev.metrics.accumulations = uint32_t(be(m_pck + 4, 4));
+                    ev.metrics.active_cycles = be(m_pck + 8, 6);
+                    break;
+                case RX_PCK::NONE:
+                    ev.value = m_opcode;
+                    break;
+                default:
+                    break;
+            }
+
+            ev.time = m_time;
+            return ev;
+        }
+
+        /* Big endian value of n bytes */
+        static uint64_t be(const uint8_t *p, int n)
+        {
+            uint64_t v = 0;
+            for(int i = 0; i < n; ++i) v = (v << 8) | p[i];
+            return v;
+        }
+
+        uint8_t  m_opcode = 0;
+        uint8_t  m_pck[14] = {};
+        int      m_len    = 0;
+        int      m_need   = 0;
+        uint32_t m_time   = 0;
+};
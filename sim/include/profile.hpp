@@ -0,0 +1,60 @@
+#pragma once
+
+/* Pipeline utilization profiler for the Verilator model
+ *
+ * Samples the rdy/vld handshakes between the core's pipeline stages once
+ * per clock cycle and classifies each stage's cycle as
+ *
+ *   busy      vld &&  rdy   a transfer happened
+ *   stall     vld && !rdy   the producer waits on the consumer
+ *   starved  !vld &&  rdy   the consumer waits on the producer
+ *   idle     !vld && !rdy
+ *
+ * and counts the cycles each module spends with step_done low. The
+ * signals are made visible to C++ by sim/ucaspian.vlt.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Vucaspian;
+
+class PipelineProfiler
+{
+    public:
+        explicit PipelineProfiler(const Vucaspian &top);
+
+        /* Call once per clock cycle, after the rising edge */
+        void sample();
+
+        void write_json(const std::string &fname) const;
+
+    private:
+        struct Stage
+        {
+            std::string    name;
+            const uint8_t *vld;
+            const uint8_t *rdy;
+            uint64_t       busy    = 0;
+            uint64_t       stall   = 0;
+            uint64_t       starved = 0;
+            uint64_t       idle    = 0;
+        };
+
+        struct Module
+        {
+            std::string    name;
+            const uint8_t *step_done;
+            uint64_t       working = 0;   // cycles with step_done low
+        };
+
+        void add_stage(const std::string &name, const uint8_t *vld, const uint8_t *rdy);
+        void add_module(const std::string &name, const uint8_t *step_done);
+
+        const Vucaspian    &m_top;
+        std::vector<Stage>  m_stages;
+        std::vector<Module> m_modules;
+        uint64_t            m_cycles      = 0;
+        uint64_t            m_core_active = 0;
+};
@@ -0,0 +1,304 @@
+#pragma once
+
+/* Binary spike raster of the uCaspian -> host stream
+ *
+ * RasterWriter decodes output bytes as they arrive and streams every output
+ * FIRE to a columnar file that RasterReader maps into memory. Values are in
+ * host byte order (little endian on x86 & ARM) and every section is 8 byte
+ * aligned:
+ *
+ *   header   RasterHeader, 48 bytes
+ *   blocks   RasterBlockHeader, uint16_t dt[count], uint8_t neuron[count]
+ *   index    RasterIndexEntry per block
+ *
+ * A block holds up to block_size spikes whose times are stored as offsets
+ * from the block's base time. A block is closed early when an offset would
+ * not fit in 16 bits or time goes backwards, which only happens after a
+ * Clear Activity / Clear Configuration (counted as a new epoch). The header
+ * is rewritten by close() with the totals and the index offset; a file
+ * whose writer never closed has an index offset of 0.
+ */
+
+#include "packets.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char     RASTER_MAGIC[8]   = {'U', 'C', 'R', 'A', 'S', 'T', 'E', 'R'};
+static constexpr uint32_t RASTER_VERSION    = 1;
+
+struct RasterHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t block_size;    // max spikes per block
+    uint64_t spikes;
+    uint64_t blocks;
+    uint64_t index_offset;  // 0 = not closed
+    uint32_t end_time;      // last TIME_UPD
+    uint32_t epochs;        // clears seen + 1
+};
+
+struct RasterBlockHeader
+{
+    uint32_t count;
+    uint32_t base_time;
+    uint32_t epoch;
+    uint32_t reserved;
+};
+
+struct RasterIndexEntry
+{
+    uint64_t offset;        // of the RasterBlockHeader
+    uint32_t first_time;
+    uint32_t last_time;
+    uint32_t count;
+    uint32_t epoch;
+};
+
+static_assert(sizeof(RasterHeader) == 48, "RasterHeader layout");
+static_assert(sizeof(RasterBlockHeader) == 16, "RasterBlockHeader layout");
+static_assert(sizeof(RasterIndexEntry) == 24, "RasterIndexEntry layout");
+
+/* Size of a block of 'count' spikes including its padding */
+inline size_t raster_block_size(uint32_t count)
+{
+    return (sizeof(RasterBlockHeader) + 3 * size_t(count) + 7) & ~size_t(7);
+}
+
+class RasterWriter
+{
+    public:
+        static constexpr uint32_t DEFAULT_BLOCK = 4096;
+
+        explicit RasterWriter(const std::string &fname, uint32_t block_size = DEFAULT_BLOCK) :
+            m_block_size(std::max<uint32_t>(1, block_size))
+        {
+            m_file = fopen(fname.c_str(), "wb");
+            if(!m_file) throw std::runtime_error("Cannot open " + fname);
+
+            std::memset(&m_header, 0, sizeof(m_header));
+            std::memcpy(m_header.magic, RASTER_MAGIC, sizeof(m_header.magic));
+            m_header.version    = RASTER_VERSION;
+            m_header.block_size = m_block_size;
+            m_header.epochs     = 1;
+            write(&m_header, sizeof(m_header));
+
+            m_dt.reserve(m_block_size);
+            m_neuron.reserve(m_block_size);
+        }
+
+        ~RasterWriter()
+        {
+            try { close(); } catch(...) {}
+        }
+
+        /* Decode a chunk of the uCaspian -> host stream */
+        void feed(const uint8_t *buf, size_t len)
+        {
+            m_rx.feed(buf, len, [this](const RxEvent &ev) {
+                if(ev.type == RX_PCK::FIRE) add(ev.time, ev.neuron);
+                else if(ev.type == RX_PCK::TIME_UPD) m_header.end_time = ev.time;
+                else if(ev.type == RX_PCK::CLEAR_ACK) new_epoch();
+            });
+        }
+
+        void add(uint32_t time, uint8_t neuron)
+        {
+            if(!m_dt.empty() && (time < m_last_time || time - m_base_time > UINT16_MAX || m_dt.size() == m_block_size))
+                flush();
+
+            if(m_dt.empty()) m_base_time = time;
+
+            m_dt.push_back(uint16_t(time - m_base_time));
+            m_neuron.push_back(neuron);
+            m_last_time = time;
+        }
+
+        /* Network time restarts from 0 (Clear Activity / Configuration) */
+        void new_epoch()
+        {
+            flush();
+            m_header.epochs++;
+            m_header.end_time = 0;
+        }
+
+        /* Write the last block, the index and the final header */
+        void close()
+        {
+            if(!m_file) return;
+
+            flush();
+
+            m_header.index_offset = m_offset;
+            m_header.blocks       = m_index.size();
+            write(m_index.data(), m_index.size() * sizeof(RasterIndexEntry));
+
+            bool ok = (fseek(m_file, 0, SEEK_SET) == 0) && fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+            ok = (fclose(m_file) == 0) && ok;
+            m_file = nullptr;
+
+            if(!ok) throw std::runtime_error("Raster write failed");
+        }
+
+        uint64_t spikes() const { return m_header.spikes + m_dt.size(); }
+
+    private:
+        void flush()
+        {
+            if(m_dt.empty()) return;
+
+            uint32_t count = m_dt.size();
+            RasterBlockHeader block = { count, m_base_time, m_header.epochs - 1, 0 };
+            m_index.push_back({ m_offset, m_base_time, m_last_time, count, block.epoch });
+
+            static const uint8_t pad[8] = {};
+            size_t used = sizeof(block) + 3 * size_t(count);
+
+            write(&block, sizeof(block));
+            write(m_dt.data(), 2 * size_t(count));
+            write(m_neuron.data(), count);
+            write(pad, raster_block_size(count) - used);
+
+            m_header.spikes += count;
+            m_dt.clear();
+            m_neuron.clear();
+        }
+
+        void write(const void *data, size_t len)
+        {
+            if(len > 0 && fwrite(data, len, 1, m_file) != 1)
+                throw std::runtime_error("Raster write failed");
+            m_offset += len;
+        }
+
+        FILE        *m_file   = nullptr;
+        uint64_t     m_offset = 0;
+        uint32_t     m_block_size;
+        RasterHeader m_header;
+        RxDecoder    m_rx;
+
+        // open block
+        uint32_t              m_base_time = 0;
+        uint32_t              m_last_time = 0;
+        std::vector<uint16_t> m_dt;
+        std::vector<uint8_t>  m_neuron;
+
+        std::vector<RasterIndexEntry> m_index;
+};
+
+/* Read-only view of a raster file mapped into memory */
+class RasterReader
+{
+    public:
+        struct Block
+        {
+            uint32_t        base_time;
+            uint32_t        count;
+            uint32_t        epoch;
+            const uint16_t *dt;       // time = base_time + dt[i]
+            const uint8_t  *neuron;
+        };
+
+        explicit RasterReader(const std::string &fname)
+        {
+            int fd = open(fname.c_str(), O_RDONLY);
+            if(fd < 0) throw std::runtime_error("Cannot open " + fname);
+
+            struct stat st;
+            if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(RasterHeader))
+            {
+                ::close(fd);
+                throw std::runtime_error(fname + " is not a spike raster");
+            }
+
+            m_size = st.st_size;
+            void *p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if(p == MAP_FAILED) throw std::runtime_error("Cannot map " + fname);
+            m_data = static_cast<const uint8_t *>(p);
+
+            const RasterHeader &h = header();
+            if(std::memcmp(h.magic, RASTER_MAGIC, sizeof(h.magic)) != 0 || h.version != RASTER_VERSION)
+                fail(fname + " is not a version " + std::to_string(RASTER_VERSION) + " spike raster");
+            if(h.index_offset == 0)
+                fail(fname + " was not closed by its writer");
+            if(h.index_offset > m_size || h.blocks > (m_size - h.index_offset) / sizeof(RasterIndexEntry))
+                fail(fname + " is truncated");
+
+            m_index = reinterpret_cast<const RasterIndexEntry *>(m_data + h.index_offset);
+            for(size_t i = 0; i < h.blocks; ++i)
+            {
+                if(m_index[i].offset + raster_block_size(m_index[i].count) > h.index_offset)
+                    fail(fname + " is truncated");
+            }
+        }
+
+        ~RasterReader()
+        {
+            munmap(const_cast<uint8_t *>(m_data), m_size);
+        }
+
+        RasterReader(const RasterReader &) = delete;
+        RasterReader &operator=(const RasterReader &) = delete;
+
+        const RasterHeader &header() const { return *reinterpret_cast<const RasterHeader *>(m_data); }
+
+        uint64_t spikes() const { return header().spikes; }
+        size_t   blocks() const { return header().blocks; }
+
+        const RasterIndexEntry &index(size_t i) const { return m_index[i]; }
+
+        Block block(size_t i) const
+        {
+            const uint8_t *p = m_data + m_index[i].offset;
+            const RasterBlockHeader *h = reinterpret_cast<const RasterBlockHeader *>(p);
+            const uint16_t *dt = reinterpret_cast<const uint16_t *>(p + sizeof(RasterBlockHeader));
+            return { h->base_time, h->count, h->epoch, dt, reinterpret_cast<const uint8_t *>(dt + h->count) };
+        }
+
+        /* First block of 'epoch' that may hold spikes at or after 'time',
+         * blocks() if there is none */
+        size_t find(uint32_t time, uint32_t epoch = 0) const
+        {
+            const RasterIndexEntry *end = m_index + blocks();
+            const RasterIndexEntry *it = std::lower_bound(m_index, end, std::make_pair(epoch, time),
+                [](const RasterIndexEntry &e, const std::pair<uint32_t, uint32_t> &key) {
+                    return e.epoch < key.first || (e.epoch == key.first && e.last_time < key.second);
+                });
+            return it - m_index;
+        }
+
+        /* Call f(epoch, time, neuron) for every spike in stream order */
+        template <typename F>
+        void for_each(F &&f) const
+        {
+            for(size_t b = 0; b < blocks(); ++b)
+            {
+                Block blk = block(b);
+                for(uint32_t i = 0; i < blk.count; ++i)
+                    f(blk.epoch, blk.base_time + blk.dt[i], blk.neuron[i]);
+            }
+        }
+
+    private:
+        void fail(const std::string &what)
+        {
+            munmap(const_cast<uint8_t *>(m_data), m_size);
+            throw std::runtime_error(what);
+        }
+
+        const uint8_t          *m_data  = nullptr;
+        size_t                  m_size  = 0;
+        const RasterIndexEntry *m_index = nullptr;
+};
@@ -0,0 +1,268 @@
+#pragma once
+
+/* Host side shadow of the uCaspian configuration RAM
+ *
+ * ConfigShadow remembers what the last loads wrote to the neuron and
+ * synapse memories so the next network can be uploaded as a delta: only
+ * the CFG_N packets and synapse ranges whose contents changed are sent.
+ * Synapse ranges are placed so that neurons keep their previous range
+ * whenever their fan-out still fits, which keeps the delta of a mutated
+ * network proportional to the mutation rather than to the network.
+ *
+ * The shadow is only valid while nothing else configures the device. Call
+ * invalidate() after a reset or a foreign upload; the next load then sends
+ * a Clear Configuration and the complete network.
+ */
+
+#include "network.hpp"
+#include "packets.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class ConfigShadow
+{
+    public:
+        static constexpr int NUM_NEURONS  = 256;
+        static constexpr int NUM_SYNAPSES = 4096;
+
+        // Unchanged synapses sent to join two changed runs: a gap of g
+        // costs 2g bytes inside a range against 5 for a new range header.
+        static constexpr int MAX_RANGE_GAP = 2;
+
+        ConfigShadow()
+        {
+            invalidate();
+        }
+
+        void invalidate()
+        {
+            m_valid = false;
+        }
+
+        /* Append the packets that turn the device configuration into 'net'
+         * to 'out' and update the shadow. Returns the number of bytes added. */
+        size_t load(const Network &net, std::vector<uint8_t> &out)
+        {
+            size_t old = out.size();
+
+            if(!m_valid)
+            {
+                Layout layout = compile_network(net);
+
+                uint8_t buf[TX_CLEAR_SIZE];
+                out.insert(out.end(), buf, buf + tx_clear_cfg(buf));
+                encode_layout(layout, out);
+
+                clear();
+                commit(layout);
+                m_valid = true;
+
+                return out.size() - old;
+            }
+
+            Layout layout = place(net);
+
+            // neurons: configured ones as compiled, dropped ones disabled
+            std::vector<NeuronConfig> target(NUM_NEURONS);
+            std::vector<bool> present(NUM_NEURONS, false);
+            for(const NeuronConfig &n : layout.neurons)
+            {
+                target[n.addr]  = n;
+                present[n.addr] = true;
+            }
+
+            for(int a = 0; a < NUM_NEURONS; ++a)
+            {
+                if(!present[a])
+                {
+                    if(!m_known[a]) continue;
+                    target[a] = NeuronConfig{uint8_t(a), 0, false, 0, 0, 0, 0};
+                }
+
+                if(m_known[a] && same(target[a], m_neuron[a])) continue;
+
+                size_t pos = out.size();
+                out.resize(pos + TX_CFG_N_SIZE);
+                tx_cfg_neuron(&out[pos], target[a]);
+            }
+
+            // synapses: every used slot whose contents differ
+            std::vector<uint16_t> changed;
+            for(const SynapseConfig &s : layout.synapses)
+            {
+                const SynapseConfig &cur = m_syn[s.addr];
+                if(cur.weight != s.weight || cur.target != s.target) changed.push_back(s.addr);
+            }
+
+            commit(layout);
+            for(int a = 0; a < NUM_NEURONS; ++a)
+            {
+                if(!present[a] && m_known[a]) m_neuron[a] = target[a];
+            }
+
+            encode_changed(changed, out);
+
+            return out.size() - old;
+        }
+
+    private:
+        static bool same(const NeuronConfig &a, const NeuronConfig &b)
+        {
+            return a.addr == b.addr && a.threshold == b.threshold && a.output == b.output &&
+                   a.leak == b.leak && a.delay == b.delay &&
+                   a.first_syn == b.first_syn && a.syn_cnt == b.syn_cnt;
+        }
+
+        /* Device state right after Clear Configuration */
+        void clear()
+        {
+            std::memset(m_known, 0, sizeof(m_known));
+            std::memset(m_cap, 0, sizeof(m_cap));
+            for(int a = 0; a < NUM_SYNAPSES; ++a)
+                m_syn[a] = SynapseConfig{uint16_t(a), 0, 0, 0};
+        }
+
+        /* Record a layout as written to the device */
+        void commit(const Layout &layout)
+        {
+            for(const NeuronConfig &n : layout.neurons)
+            {
+                m_neuron[n.addr] = n;
+                m_known[n.addr]  = true;
+                m_cap[n.addr]    = std::max<int>(n.syn_cnt, m_cap[n.addr]);
+            }
+
+            for(const SynapseConfig &s : layout.synapses)
+                m_syn[s.addr] = s;
+        }
+
+        /* Lay out 'net' reusing each neuron's current synapse range where
+         * its new fan-out fits, allocating first-fit otherwise. Falls back
+         * to a compact layout if synapse memory is too fragmented. */
+        Layout place(const Network &net)
+        {
+            Layout layout = compile_network(net);
+
+            std::vector<bool> used(NUM_SYNAPSES, false);
+            std::vector<int>  first(layout.neurons.size(), -1);
+            std::vector<int>  cap(NUM_NEURONS, 0);
+
+            // keep ranges that still fit
+            for(size_t i = 0; i < layout.neurons.size(); ++i)
+            {
+                const NeuronConfig &n = layout.neurons[i];
+                if(n.syn_cnt == 0 || !m_known[n.addr] || n.syn_cnt > m_cap[n.addr]) continue;
+
+                first[i]    = m_neuron[n.addr].first_syn;
+                cap[n.addr] = m_cap[n.addr];
+                for(int s = 0; s < cap[n.addr]; ++s) used[(first[i] + s) % NUM_SYNAPSES] = true;
+            }
+
+            // allocate the rest
+            for(size_t i = 0; i < layout.neurons.size(); ++i)
+            {
+                const NeuronConfig &n = layout.neurons[i];
+                if(n.syn_cnt == 0 || first[i] >= 0) continue;
+
+                int run = 0;
+                for(int a = 0; a < NUM_SYNAPSES && first[i] < 0; ++a)
+                {
+                    run = used[a] ? 0 : run + 1;
+                    if(run == n.syn_cnt) first[i] = a - run + 1;
+                }
+
+                if(first[i] < 0)
+                {
+                    // fragmented: start over from the compact layout
+                    std::memset(m_cap, 0, sizeof(m_cap));
+                    return layout;
+                }
+
+                cap[n.addr] = n.syn_cnt;
+                for(int s = 0; s < n.syn_cnt; ++s) used[first[i] + s] = true;
+            }
+
+            // move each neuron's synapses into its range, keeping a synapse
+            // in the slot that already holds its target where possible
+            Layout placed;
+            placed.neurons = layout.neurons;
+
+            size_t syn = 0;
+            for(size_t i = 0; i < layout.neurons.size(); ++i)
+            {
+                NeuronConfig &n = placed.neurons[i];
+                int cnt = n.syn_cnt;
+
+                n.first_syn = (cnt == 0) ? 0 : first[i];
+
+                std::vector<const SynapseConfig *> slot(cnt, nullptr);
+                std::vector<const SynapseConfig *> rest;
+
+                for(int s = 0; s < cnt; ++s)
+                {
+                    const SynapseConfig &src = layout.synapses[syn + s];
+                    bool kept = false;
+
+                    for(int j = 0; j < cnt && !kept; ++j)
+                    {
+                        if(!slot[j] && m_syn[(n.first_syn + j) % NUM_SYNAPSES].target == src.target)
+                        {
+                            slot[j] = &src;
+                            kept = true;
+                        }
+                    }
+
+                    if(!kept) rest.push_back(&src);
+                }
+
+                size_t r = 0;
+                for(int j = 0; j < cnt; ++j)
+                {
+                    const SynapseConfig *src = slot[j] ? slot[j] : rest[r++];
+                    placed.synapses.push_back({uint16_t((n.first_syn + j) % NUM_SYNAPSES), src->weight, src->target, 0});
+                }
+
+                syn += cnt;
+            }
+
+            std::memcpy(m_cap, cap.data(), sizeof(m_cap));
+            std::sort(placed.synapses.begin(), placed.synapses.end(),
+                      [](const SynapseConfig &a, const SynapseConfig &b) { return a.addr < b.addr; });
+
+            return placed;
+        }
+
+        /* Send the changed synapse addresses (from the updated shadow),
+         * joining runs separated by small gaps into one range */
+        void encode_changed(std::vector<uint16_t> &changed, std::vector<uint8_t> &out)
+        {
+            std::sort(changed.begin(), changed.end());
+
+            std::vector<SynapseConfig> send;
+            for(size_t i = 0; i < changed.size(); ++i)
+            {
+                uint16_t a = changed[i];
+                if(!send.empty())
+                {
+                    int gap = a - send.back().addr - 1;
+                    if(gap > 0 && gap <= MAX_RANGE_GAP)
+                    {
+                        for(uint16_t g = send.back().addr + 1; g < a; ++g) send.push_back(m_syn[g]);
+                    }
+                }
+                send.push_back(m_syn[a]);
+            }
+
+            encode_synapses(send.data(), send.size(), out);
+        }
+
+        bool         m_valid;
+
+        NeuronConfig  m_neuron[NUM_NEURONS];
+        bool          m_known[NUM_NEURONS];
+        int           m_cap[NUM_NEURONS];     // synapse slots reserved per neuron
+        SynapseConfig m_syn[NUM_SYNAPSES];
+};
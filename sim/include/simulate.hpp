@@ -0,0 +1,98 @@
+#pragma once
+
+#include "verilated.h"
+
+#include "link.hpp"
+#include "stall.hpp"
+
+#include <cstdint>
+#include <string>
+
+struct SimConfig
+{
+    uint64_t    max_steps = 8192;
+    std::string trace_file;         // empty = no waveform trace
+
+    // Trace only cycles [trace_start, trace_end). If trace_opcode is set
+    // (>= 0) the window is relative to the cycle the first packet with that
+    // opcode is presented on read_data, and nothing is traced before it.
+    uint64_t    trace_start = 0;
+    uint64_t    trace_end = UINT64_MAX;
+    int         trace_opcode = -1;
+
+    // Host link stall models of the RX / TX FIFOs as "kind:args" (empty =
+    // never stall), seeded from stall_seed, see stall.hpp
+    std::string stall_in;
+    std::string stall_out;
+    uint64_t    stall_seed = 1;
+
+    // Pace the FIFOs at the rate of a board's host link (empty = ideal),
+    // with link rates relative to a sys_clk of clock_hz, see link.hpp
+    std::string link;
+    uint64_t    clock_hz = 24000000;
+
+    // Print the link throughput of the stall models and the time estimate
+    // of the link after the run (batch jobs leave it to the batch summary)
+    bool        link_report = true;
+
+    // Stop once the input is drained, the core is idle, and no output has
+    // appeared for this many cycles (0 = always run to max_steps)
+    uint64_t    idle_cycles = 0;
+
+    // Send the input through a ConfigUploader with this credit window in
+    // bytes instead of streaming it (0 = stream)
+    size_t      upload_window = 0;
+
+    // Write the per-event input to output latency CSV here and print a
+    // percentile summary (empty = off), see latency.hpp
+    std::string latency_file;
+
+    // Write per-stage pipeline utilization as JSON here (empty = off),
+    // see profile.hpp
+    std::string profile_file;
+
+    // Restore the model from this checkpoint before sending the input, and
+    // save it here once the input has been consumed and the design is
+    // quiescent (empty = off). Needs a --savable model (make test-savable).
+    std::string restore_file;
+    std::string checkpoint_file;
+
+    // Stream the output FIREs to a spike raster here as they are produced
+    // (empty = off), see raster.hpp
+    std::string raster_file;
+};
+
+/* Simulate one Vucaspian model with packets from input_file, writing the
+ * output packets to output_file. Each call builds its own model inside
+ * 'ctx', so independent contexts may be simulated from separate threads.
+ * Returns the number of clock cycles simulated. In quiescent mode this
+ * is the cycle the design went idle, or max_steps + 1 if it never did. */
+uint64_t simulate(VerilatedContext &ctx, const std::string &input_file,
+                  const std::string &output_file, const SimConfig &cfg);
+
+/* Simulate every input/output pair listed in a manifest file on a pool
+ * of 'jobs' worker threads. Returns the number of failed runs. */
+int simulate_batch(const std::string &manifest, unsigned jobs, const SimConfig &cfg);
+
+/* Serve the uCaspian byte stream of one persistent model until SIGINT or
+ * SIGTERM, on a Unix domain socket at 'path' (one client at a time) or on
+ * a pseudo-terminal linked to 'path'. Returns 0 on a clean stop. */
+int serve(const std::string &path, bool pty, const SimConfig &cfg);
+
+/* Stall models of the RX / TX FIFOs described by 'cfg', each with its own
+ * stream from the seed */
+inline StallModel input_stall(const SimConfig &cfg)
+{
+    return cfg.stall_in.empty() ? StallModel() : StallModel::parse(cfg.stall_in, 2 * cfg.stall_seed);
+}
+
+inline StallModel output_stall(const SimConfig &cfg)
+{
+    return cfg.stall_out.empty() ? StallModel() : StallModel::parse(cfg.stall_out, 2 * cfg.stall_seed + 1);
+}
+
+/* Host link timing described by 'cfg' */
+inline LinkTiming link_timing(const SimConfig &cfg)
+{
+    return cfg.link.empty() ? LinkTiming() : LinkTiming::parse(cfg.link, cfg.clock_hz);
+}
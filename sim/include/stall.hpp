@@ -0,0 +1,142 @@
+#pragma once
+
+/* Host link stall models for FakeFifo
+ *
+ * A real host link does not present a byte, or take one, on every clock
+ * cycle. A StallModel decides once per cycle whether the host side of a
+ * FIFO holds off: the RX side then drops read_vld, the TX side drops
+ * write_rdy. Models are written as "kind:args":
+ *
+ *   none                   never stall
+ *   bernoulli:p            stall each cycle with probability p
+ *   burst:on:off           alternate ready and stalled bursts with mean
+ *                          lengths of 'on' and 'off' cycles (geometric)
+ *   duty:period:ready      ready for the first 'ready' cycles of every
+ *                          'period'
+ *
+ * The random models draw from their own xorshift generator, so a run is
+ * reproducible from its seed whatever else uses rand().
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class StallModel
+{
+    public:
+        enum class Kind { NONE, BERNOULLI, BURST, DUTY };
+
+        StallModel() {}
+
+        /* Build a model from its "kind:args" description. Throws on an
+         * unknown kind or out of range arguments. */
+        static StallModel parse(const std::string &spec, uint64_t seed = 1)
+        {
+            std::vector<std::string> f;
+            size_t pos = 0;
+            while(true)
+            {
+                size_t colon = spec.find(':', pos);
+                f.push_back(spec.substr(pos, colon - pos));
+                if(colon == std::string::npos) break;
+                pos = colon + 1;
+            }
+
+            StallModel m;
+            m.m_state = seed * 0x9E3779B97F4A7C15ull + 0x2545F4914F6CDD1Dull;
+            if(m.m_state == 0) m.m_state = 1;
+
+            auto bad = [&]() { return std::runtime_error("Invalid stall model '" + spec + "'"); };
+            auto num = [&](const std::string &s) {
+                char *end;
+                double v = strtod(s.c_str(), &end);
+                if(s.empty() || *end != '\0' || !(v >= 0)) throw bad();
+                return v;
+            };
+
+            if(f[0] == "none" && f.size() == 1)
+            {
+                m.m_kind = Kind::NONE;
+            }
+            else if(f[0] == "bernoulli" && f.size() == 2)
+            {
+                double p = num(f[1]);
+                if(p > 1) throw bad();
+                m.m_kind     = Kind::BERNOULLI;
+                m.m_stall_at = threshold(p);
+            }
+            else if(f[0] == "burst" && f.size() == 3)
+            {
+                double on = num(f[1]), off = num(f[2]);
+                if(on < 1 || off < 1) throw bad();
+                m.m_kind     = Kind::BURST;
+                m.m_stall_at = threshold(1 / on);    // ready -> stalled
+                m.m_ready_at = threshold(1 / off);   // stalled -> ready
+            }
+            else if(f[0] == "duty" && f.size() == 3)
+            {
+                double period = num(f[1]), ready = num(f[2]);
+                if(period < 1 || ready > period) throw bad();
+                m.m_kind   = Kind::DUTY;
+                m.m_period = uint64_t(period);
+                m.m_ready  = uint64_t(ready);
+            }
+            else
+            {
+                throw bad();
+            }
+
+            return m;
+        }
+
+        bool active() const { return m_kind != Kind::NONE; }
+
+        /* Advance one cycle, true if the host holds off this cycle */
+        bool stall()
+        {
+            switch(m_kind)
+            {
+                case Kind::BERNOULLI:
+                    return next() < m_stall_at;
+                case Kind::BURST:
+                    if(next() < (m_stalled ? m_ready_at : m_stall_at)) m_stalled = !m_stalled;
+                    return m_stalled;
+                case Kind::DUTY:
+                {
+                    bool ready = m_phase < m_ready;
+                    if(++m_phase == m_period) m_phase = 0;
+                    return !ready;
+                }
+                default:
+                    return false;
+            }
+        }
+
+    private:
+        /* next() < threshold(p) with probability p */
+        static uint64_t threshold(double p)
+        {
+            return (p >= 1) ? UINT64_MAX : uint64_t(p * 18446744073709551616.0);
+        }
+
+        /* xorshift64* */
+        uint64_t next()
+        {
+            m_state ^= m_state >> 12;
+            m_state ^= m_state << 25;
+            m_state ^= m_state >> 27;
+            return m_state * 0x2545F4914F6CDD1Dull;
+        }
+
+        Kind     m_kind     = Kind::NONE;
+        uint64_t m_state    = 1;
+        uint64_t m_stall_at = 0;
+        uint64_t m_ready_at = 0;
+        bool     m_stalled  = false;
+        uint64_t m_period   = 1;
+        uint64_t m_ready    = 1;
+        uint64_t m_phase    = 0;
+};
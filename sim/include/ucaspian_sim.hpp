@@ -0,0 +1,144 @@
+#pragma once
+
+/* Embeddable uCaspian simulator
+ *
+ * UcaspianSim keeps one Verilator model and its host FIFOs alive between
+ * evaluations, so a host program can drive many runs from memory without
+ * a process, model construction, or file round trip per run:
+ *
+ *   UcaspianSim sim;
+ *   sim.write(packets.data(), packets.size());
+ *   sim.run_until_idle(64);
+ *   sim.read(output);
+ *
+ * write() queues host -> uCaspian bytes without bound; they are moved into
+ * the 512 byte RX FIFO as it drains. Output bytes collect on the host side
+ * until read(). The clock only advances inside run() / run_until_idle().
+ * A new model starts in reset, which the first three cycles hold.
+ *
+ * Built into build/libucaspian_sim.so (make lib); only this header,
+ * fifo.hpp, stall.hpp, and link.hpp are needed to use it.
+ */
+
+#include "fifo.hpp"
+#include "link.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__)
+#define UCASPIAN_SIM_API __attribute__((visibility("default")))
+#else
+#define UCASPIAN_SIM_API
+#endif
+
+class Vucaspian;
+class VerilatedContext;
+class VerilatedFstC;
+
+class UCASPIAN_SIM_API UcaspianSim
+{
+    public:
+        /* Build the model in 'ctx', or in a context of its own if null.
+         * A trace file is only written by models built with tracing. */
+        explicit UcaspianSim(VerilatedContext *ctx = nullptr, const std::string &trace_file = "");
+        ~UcaspianSim();
+
+        UcaspianSim(const UcaspianSim &) = delete;
+        UcaspianSim &operator=(const UcaspianSim &) = delete;
+
+        /* Queue host -> uCaspian bytes */
+        void write(const uint8_t *data, size_t len);
+        void write(const std::vector<uint8_t> &data) { write(data.data(), data.size()); }
+
+        /* Copy out up to 'len' uCaspian -> host bytes, returns the count */
+        size_t read(uint8_t *data, size_t len);
+
+        /* Append every uCaspian -> host byte available to 'out' */
+        size_t read(std::vector<uint8_t> &out);
+
+        /* Output bytes waiting to be read */
+        size_t available() const;
+
+        /* Advance the clock by 'cycles' */
+        void run(uint64_t cycles);
+
+        /* Run until the design has been quiescent for 'idle_cycles': all
+         * input consumed, the core inactive with step_done settled, and no
+         * new output. Returns false if that did not happen within
+         * 'max_cycles'. */
+        bool run_until_idle(uint64_t idle_cycles, uint64_t max_cycles = UINT64_MAX);
+
+        /* Assert reset for the next three cycles and drop all buffered
+         * input & output. Reset idles the packet interface and the core
+         * pipelines but leaves the neuron charges and the configuration in
+         * their memories: send Clear Activity or Clear Configuration. */
+        void reset();
+
+        /* One clock cycle */
+        void tick();
+
+        /* Work is pending in the host buffers, the RX FIFO, the host link,
+         * or the core */
+        bool busy() const;
+
+        /* Clock cycles simulated since construction */
+        uint64_t cycle() const { return m_cycle; }
+
+        /* Cycle of the last busy() cycle or output byte seen by run_until_idle */
+        uint64_t last_busy() const { return m_last_busy; }
+
+        /* Input bytes accepted by the design / output bytes it produced */
+        uint64_t consumed() const { return m_pushed - m_fifo_in.size(); }
+        uint64_t produced() const { return m_popped + m_fifo_out.size(); }
+
+        /* Checkpoint the model, e.g. once a network is configured, and
+         * restore it into a fresh instance. save() needs the input to be
+         * fully consumed; unread output is saved with the model. Cycle
+         * counts restart from the checkpoint. Both throw unless the model
+         * was built with --savable (make test-savable). */
+        void save(const std::string &fname);
+        void restore(const std::string &fname);
+
+        /* Pace both FIFOs at the rate of a board's host link, see link.hpp */
+        void link(const LinkTiming &timing);
+
+        /* Only dump cycles [start, end) to the trace */
+        void trace_window(uint64_t start, uint64_t end);
+
+        /* Direct access for the command line harness & profilers. Host link
+         * stalls are set on the FIFOs, see FakeFifo::stall. */
+        Vucaspian        &model()       { return *m_top; }
+        VerilatedContext &context()     { return *m_ctx; }
+        ByteFifo         &input_fifo()  { return m_fifo_in; }
+        ByteFifo         &output_fifo() { return m_fifo_out; }
+
+    private:
+        void drain_output();
+
+        std::unique_ptr<VerilatedContext> m_own_ctx;
+        VerilatedContext                 *m_ctx;
+        std::unique_ptr<Vucaspian>        m_top;
+
+        ByteFifo   m_fifo_in;
+        ByteFifo   m_fifo_out;
+        LinkTiming m_link;
+
+        // host side buffers
+        std::vector<uint8_t> m_input;
+        size_t               m_input_pos = 0;
+        std::vector<uint8_t> m_output;
+        size_t               m_output_pos = 0;
+        uint64_t             m_pushed = 0;      // bytes moved into the RX FIFO
+        uint64_t             m_popped = 0;      // bytes moved out of the TX FIFO
+
+        uint64_t m_cycle       = 0;
+        uint64_t m_last_busy   = 0;
+        int      m_reset_left  = 3;
+
+        VerilatedFstC *m_fst         = nullptr;
+        uint64_t       m_trace_start = 0;
+        uint64_t       m_trace_end   = UINT64_MAX;
+};
@@ -0,0 +1,286 @@
+#pragma once
+
+/* Pipelined packet upload with credit based flow control
+ *
+ * The uCaspian RX FIFO holds 512 bytes and the serial links have no flow
+ * control of their own, so the host may only have as many unconsumed bytes
+ * in flight as the FIFO can hold. Rather than waiting for each ack before
+ * sending the next packet, ConfigUploader keeps a window of bytes in flight
+ * and returns credit as responses come back. A response proves that its
+ * packet -- and every packet sent before it -- has left the FIFO:
+ *
+ *   CFG_N, CFG_SYN, CFG_SYNS   CFG_ACK
+ *   CLEAR_ACT, CLEAR_CFG       CLEAR_ACK
+ *   METRIC                     METRIC
+ *   METRIC_ALL                 METRIC_ALL
+ *   STEP n (n > 0)             TIME_UPD with the new target time
+ *   FIRE, FIRES, FIRE_MAP,     none, released by a later response
+ *   NOOP, STEP 0
+ *
+ * A Get Metric of address 0 is inserted as a probe whenever the bytes
+ * queued since the last response would exceed half a window (or a whole
+ * window ahead of a packet that does respond), so credit always comes back.
+ * Probe replies are not passed on.
+ *
+ * A STEP is matched by the network time its TIME_UPD reports, counted from
+ * the last Clear Activity / Configuration queued. Before the first clear the
+ * device time is unknown (a board left running, or a restored checkpoint),
+ * so the first STEP is followed by a probe: the last TIME_UPD before the
+ * probe's reply ends that run and gives the starting time.
+ * Configure Synapses ranges larger than the window are split so that every
+ * packet fits. The uploader does no I/O itself: send() hands out the next
+ * bytes that may be written and receive() consumes the response stream.
+ */
+
+#include "packets.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+class ConfigUploader
+{
+    public:
+        static constexpr size_t MIN_WINDOW = 8;
+
+        explicit ConfigUploader(size_t window = 512) :
+            m_window(window < MIN_WINDOW ? MIN_WINDOW : window)
+        {
+        }
+
+        /* Queue a stream of complete host -> uCaspian packets */
+        void queue(const uint8_t *buf, size_t len)
+        {
+            size_t pos = 0;
+            while(pos < len)
+            {
+                size_t size = tx_packet_size(buf + pos, len - pos);
+                if(size == 0 || pos + size > len)
+                    throw std::runtime_error("ConfigUploader: incomplete packet at end of stream");
+
+                if(buf[pos] == opcode(TX_PCK::CFG_SYNS) && size > m_window)
+                    queue_split_range(buf + pos);
+                else
+                    queue_packet(buf + pos, size);
+
+                pos += size;
+            }
+        }
+
+        /* Append the queued packets that fit in the credit window to 'out'.
+         * A packet larger than the window is sent alone. Returns the number
+         * of bytes appended. */
+        size_t send(std::vector<uint8_t> &out)
+        {
+            size_t old = out.size();
+
+            while(m_next < m_packets.size())
+            {
+                const Packet &p = m_packets[m_next];
+                if(m_in_flight > 0 && m_in_flight + p.size > m_window) break;
+
+                out.insert(out.end(), m_data.begin() + p.offset, m_data.begin() + p.offset + p.size);
+                m_in_flight += p.size;
+                m_next++;
+            }
+
+            return out.size() - old;
+        }
+
+        /* Consume uCaspian -> host bytes, returning credit for every
+         * acknowledged packet. Each decoded event is also passed on. */
+        template <typename F>
+        void receive(const uint8_t *buf, size_t len, F &&on_event)
+        {
+            m_rx.feed(buf, len, [&](const RxEvent &ev) {
+                if(!acknowledge(ev)) on_event(ev);
+            });
+        }
+
+        void receive(const uint8_t *buf, size_t len)
+        {
+            receive(buf, len, [](const RxEvent &) {});
+        }
+
+        /* Bytes of the packets not yet released, exactly as send() will
+         * hand them out (including probes & split ranges) */
+        const std::vector<uint8_t> &queued() const { return m_data; }
+
+        /* Bytes sent but not yet known to have left the RX FIFO */
+        size_t in_flight() const { return m_in_flight; }
+
+        /* Packets not yet sent */
+        size_t pending() const { return m_packets.size() - m_next; }
+
+        /* Everything has been sent and every expected response received */
+        bool idle() const { return pending() == 0 && m_awaiting == 0; }
+
+    private:
+        struct Packet
+        {
+            size_t   offset;
+            size_t   size;
+            RX_PCK   response;  // NONE if the packet has no response
+            uint32_t time;      // STEP: target time reported by its TIME_UPD
+            bool     probe;     // inserted by the uploader
+            bool     relative;  // STEP: time counted from the unknown start time
+        };
+
+        void queue_packet(const uint8_t *pck, size_t size, bool probe = false)
+        {
+            Packet p = { m_data.size(), size, RX_PCK::NONE, 0, probe, false };
+            bool delimit = false;
+
+            switch(static_cast<TX_PCK>(pck[0]))
+            {
+                case TX_PCK::CFG_N:
+                case TX_PCK::CFG_SYN:
+                case TX_PCK::CFG_SYNS:
+                    p.response = RX_PCK::CFG_ACK;
+                    break;
+                case TX_PCK::CLEAR_ACT:
+                case TX_PCK::CLEAR_CFG:
+                    p.response = RX_PCK::CLEAR_ACK;
+                    m_target = 0;
+                    m_cleared = true;
+                    break;
+                case TX_PCK::METRIC:
+                    p.response = RX_PCK::METRIC;
+                    break;
+                case TX_PCK::METRIC_ALL:
+                    p.response = RX_PCK::METRIC_ALL;
+                    break;
+                case TX_PCK::STEP:
+                    if(pck[1] == 0) break;
+                    m_target += pck[1];
+                    p.response = RX_PCK::TIME_UPD;
+                    p.time     = m_target;
+                    p.relative = !m_cleared;
+                    delimit    = p.relative && !m_delimited;
+                    m_delimited |= delimit;
+                    break;
+                default:
+                    break;
+            }
+
+            // never leave more unanswered bytes in flight than the window
+            size_t limit = (p.response == RX_PCK::NONE) ? m_window / 2 : m_window;
+            if(m_silent > 0 && m_silent + size > limit)
+            {
+                uint8_t buf[TX_METRIC_SIZE];
+                queue_packet(buf, tx_metric(buf, 0), true);
+            }
+
+            if(p.response != RX_PCK::NONE)
+            {
+                m_awaiting++;
+                m_silent = 0;
+            }
+            else
+            {
+                m_silent += size;
+            }
+
+            p.offset = m_data.size();
+            m_data.insert(m_data.end(), pck, pck + size);
+            m_packets.push_back(p);
+
+            if(delimit)
+            {
+                uint8_t buf[TX_METRIC_SIZE];
+                queue_packet(buf, tx_metric(buf, 0), true);
+            }
+        }
+
+        /* Re-encode a Configure Synapses range as ranges that fit the window */
+        void queue_split_range(const uint8_t *pck)
+        {
+            uint16_t start = ((pck[1] & 0x0F) << 8) | pck[2];
+            uint16_t end   = ((pck[3] & 0x0F) << 8) | pck[4];
+            int      count = ((end - start) & 0x0FFF) + 1;
+            int      chunk = std::max<int>(1, (int(m_window) - tx_cfg_synapses_size(0)) / 2);
+
+            std::vector<SynapseConfig> syns(count);
+            for(int i = 0; i < count; ++i)
+            {
+                syns[i].weight = static_cast<int8_t>(pck[5 + 2 * i]);
+                syns[i].target = pck[6 + 2 * i];
+            }
+
+            std::vector<uint8_t> buf(tx_cfg_synapses_size(chunk));
+            for(int i = 0; i < count; i += chunk)
+            {
+                int n = std::min(chunk, count - i);
+                queue_packet(buf.data(), tx_cfg_synapses(buf.data(), (start + i) & 0x0FFF, &syns[i], n));
+            }
+        }
+
+        /* Release the oldest outstanding packet expecting this response,
+         * together with everything sent before it. Returns true if the
+         * event answered a probe. */
+        bool acknowledge(const RxEvent &ev)
+        {
+            for(size_t i = 0; i < m_next; ++i)
+            {
+                const Packet &p = m_packets[i];
+                if(p.response == RX_PCK::NONE) continue;
+
+                if(p.relative && !m_start_known)
+                {
+                    // the first run ends with the last TIME_UPD before the
+                    // reply of the probe queued after it
+                    if(ev.type == RX_PCK::TIME_UPD) m_last_time = ev.time;
+                    if(ev.type != RX_PCK::METRIC) return false;
+
+                    m_start       = m_last_time - p.time;
+                    m_start_known = true;
+                    release(i);
+                    return acknowledge(ev);
+                }
+
+                uint32_t time = p.relative ? m_start + p.time : p.time;
+                if(p.response != ev.type || (ev.type == RX_PCK::TIME_UPD && ev.time != time))
+                    return false;
+
+                bool probe = p.probe;
+                release(i);
+                return probe;
+            }
+
+            return false;
+        }
+
+        /* Release m_packets[0..i] */
+        void release(size_t i)
+        {
+            for(size_t j = 0; j <= i; ++j)
+            {
+                m_in_flight -= m_packets.front().size;
+                m_packets.pop_front();
+            }
+            m_next -= i + 1;
+            m_awaiting--;
+
+            // drop the bytes of released packets once nothing refers to them
+            if(m_packets.empty()) m_data.clear();
+        }
+
+        size_t               m_window;
+        size_t               m_in_flight = 0;
+        size_t               m_awaiting  = 0;   // packets still expecting a response
+        uint32_t             m_target    = 0;   // network time after the queued STEPs
+        bool                 m_cleared   = false;   // m_target counts from a queued clear
+        bool                 m_delimited = false;   // probe queued after the first STEP
+        bool                 m_start_known = false;
+        uint32_t             m_start     = 0;   // device time before the first STEP
+        uint32_t             m_last_time = 0;   // last TIME_UPD of the first STEP
+        size_t               m_silent    = 0;   // bytes queued since the last response
+
+        std::vector<uint8_t> m_data;            // bytes of the queued packets
+        std::deque<Packet>   m_packets;         // sent (< m_next) and unsent packets
+        size_t               m_next = 0;
+
+        RxDecoder            m_rx;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+/* Random workloads for the benchmark tools
+ *
+ * The generators (ucaspian_mutate, ucaspian_inputs) build random networks
+ * and write several packet files that must drive the design the same way.
+ * check_engine() runs each file through the reference engine and compares
+ * the spikes & time updates they produce, so a generator never hands a
+ * benchmark script files that disagree.
+ */
+
+#include "engine.hpp"
+#include "network.hpp"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+struct RandomShape
+{
+    int     neurons;
+    int     outputs;            // the last 'outputs' neurons
+    uint8_t max_threshold;
+    int     first_target;       // synapses target neurons [first_target, neurons)
+    bool    output_fan_out;     // output neurons have synapses too
+};
+
+inline Network random_network(std::mt19937 &rng, const RandomShape &shape)
+{
+    Network net;
+    std::uniform_int_distribution<int> threshold(0, shape.max_threshold), fan_out(0, 12),
+                                       target(shape.first_target, shape.neurons - 1), weight(-32, 96);
+
+    for(int n = 0; n < shape.neurons; ++n)
+        net.neurons.push_back({uint8_t(n), uint8_t(threshold(rng)), -1, 0, n >= shape.neurons - shape.outputs});
+
+    int sources = shape.output_fan_out ? shape.neurons : shape.neurons - shape.outputs;
+    for(int n = 0; n < sources; ++n)
+        for(int s = fan_out(rng); s > 0; --s)
+            net.synapses.push_back({uint8_t(n), uint8_t(target(rng)), int8_t(weight(rng))});
+
+    return net;
+}
+
+/* Spikes & time updates produced by a packet file, acks dropped */
+inline std::vector<RxEvent> engine_events(const std::vector<uint8_t> &input)
+{
+    UcaspianEngine engine;
+    std::vector<uint8_t> output;
+    engine.process(input.data(), input.size(), output);
+
+    std::vector<RxEvent> events;
+    RxDecoder rx;
+    rx.feed(output.data(), output.size(), [&](const RxEvent &ev) {
+        if(ev.type == RX_PCK::FIRE || ev.type == RX_PCK::TIME_UPD) events.push_back(ev);
+    });
+    return events;
+}
+
+inline bool same_events(const std::vector<RxEvent> &a, const std::vector<RxEvent> &b)
+{
+    bool match = (a.size() == b.size());
+    for(size_t i = 0; match && i < a.size(); ++i)
+        match = (a[i].type == b[i].type && a[i].time == b[i].time && a[i].neuron == b[i].neuron);
+    return match;
+}
+
+/* Run every packet file through the reference engine and report whether
+ * they all produce the events of the first one */
+inline bool check_engine(const char *name, const std::vector<const std::vector<uint8_t> *> &files)
+{
+    std::vector<RxEvent> first = engine_events(*files[0]);
+
+    bool match = true;
+    for(size_t i = 1; match && i < files.size(); ++i)
+        match = same_events(first, engine_events(*files[i]));
+
+    std::cout << name << ": " << first.size() << " events, " << (match ? "outputs match" : "OUTPUTS DIFFER") << std::endl;
+    return match;
+}
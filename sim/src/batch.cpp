@@ -0,0 +1,160 @@
+#include "verilated.h"
+
+#include "simulate.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct Job
+{
+    std::string input_file;
+    std::string output_file;
+    uint64_t    max_steps;
+};
+
+/* Per-worker job queue. The owner pops from the back; idle workers steal
+ * from the front so long runs do not leave the rest of the pool waiting. */
+class WorkQueue
+{
+    public:
+        void push(size_t job)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_jobs.push_back(job);
+        }
+
+        bool pop(size_t &job)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if(m_jobs.empty()) return false;
+            job = m_jobs.back();
+            m_jobs.pop_back();
+            return true;
+        }
+
+        bool steal(size_t &job)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if(m_jobs.empty()) return false;
+            job = m_jobs.front();
+            m_jobs.pop_front();
+            return true;
+        }
+
+    private:
+        std::mutex         m_lock;
+        std::deque<size_t> m_jobs;
+};
+
+/* Manifest format: one run per line, "input_file output_file (max_steps)".
+ * Blank lines and lines starting with '#' are ignored. */
+std::vector<Job> read_manifest(const std::string &fname, uint64_t default_steps)
+{
+    std::ifstream file(fname);
+    if(!file) throw std::runtime_error("Cannot open manifest " + fname);
+
+    std::vector<Job> jobs;
+    std::string line;
+    while(std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        Job job;
+        job.max_steps = default_steps;
+
+        if(!(fields >> job.input_file) || job.input_file[0] == '#') continue;
+        if(!(fields >> job.output_file))
+            throw std::runtime_error("Missing output file for " + job.input_file);
+        fields >> job.max_steps;
+
+        jobs.push_back(job);
+    }
+
+    return jobs;
+}
+
+}
+
+int simulate_batch(const std::string &manifest, unsigned jobs, const SimConfig &cfg)
+{
+    std::vector<Job> runs = read_manifest(manifest, cfg.max_steps);
+
+    if(jobs == 0) jobs = std::thread::hardware_concurrency();
+    if(jobs == 0) jobs = 1;
+    if(jobs > runs.size()) jobs = runs.size();
+
+    // deal the runs out round robin; work stealing evens out the rest
+    std::vector<WorkQueue> queues(jobs);
+    for(size_t i = 0; i < runs.size(); ++i) queues[i % jobs].push(i);
+
+    std::atomic<int>      failed(0);
+    std::atomic<uint64_t> cycles(0);
+    std::mutex            log_lock;
+
+    auto worker = [&](unsigned id)
+    {
+        size_t idx;
+        while(true)
+        {
+            bool found = queues[id].pop(idx);
+            for(unsigned v = 1; !found && v < jobs; ++v)
+                found = queues[(id + v) % jobs].steal(idx);
+            if(!found) break;
+
+            const Job &job = runs[idx];
+            SimConfig job_cfg = cfg;
+            job_cfg.max_steps  = job.max_steps;
+            job_cfg.trace_file = "";
+            job_cfg.latency_file = "";
+            job_cfg.profile_file = "";
+            job_cfg.checkpoint_file = "";
+            job_cfg.raster_file = "";
+            job_cfg.link_report = false;
+
+            try
+            {
+                // each model gets its own context to run independently
+                VerilatedContext ctx;
+                cycles += simulate(ctx, job.input_file, job.output_file, job_cfg);
+            }
+            catch(const std::exception &e)
+            {
+                std::lock_guard<std::mutex> lock(log_lock);
+                std::cerr << job.input_file << ": " << e.what() << std::endl;
+                failed++;
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> pool;
+    for(unsigned i = 0; i < jobs; ++i) pool.emplace_back(worker, i);
+    for(auto &t : pool) t.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << runs.size() << " runs, " << jobs << " threads, "
+              << cycles << " cycles, " << elapsed.count() << " s" << std::endl;
+
+    if(!cfg.link.empty())
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "Estimated %.3f ms for all runs on %s (%.1f MHz sys_clk)",
+                 1e3 * cycles / cfg.clock_hz, cfg.link.c_str(), cfg.clock_hz / 1e6);
+        std::cout << line << std::endl;
+    }
+
+    return failed;
+}
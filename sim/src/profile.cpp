@@ -0,0 +1,104 @@
+#include "Vucaspian.h"
+#include "Vucaspian___024root.h"
+
+#include "profile.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+PipelineProfiler::PipelineProfiler(const Vucaspian &top) : m_top(top)
+{
+    const Vucaspian___024root *root = top.rootp;
+
+    // in pipeline order, from the packet interface to the host
+    add_stage("host_rx",    &top.read_vld, &top.read_rdy);
+    add_stage("input_fire", &root->ucaspian__DOT__core__DOT__dend_in_vld, &root->ucaspian__DOT__core__DOT__dend_in_rdy);
+    add_stage("neuron",     &root->ucaspian__DOT__core__DOT__neuron_vld,  &root->ucaspian__DOT__core__DOT__neuron_rdy);
+    add_stage("axon",       &root->ucaspian__DOT__core__DOT__axon_vld,    &root->ucaspian__DOT__core__DOT__axon_rdy);
+    add_stage("axon_syn",   &root->ucaspian__DOT__core__DOT__axon_syn_vld, &root->ucaspian__DOT__core__DOT__axon_syn_rdy);
+    for(int i = 0; i < 4; ++i)
+        add_stage("syn_addr_" + std::to_string(i),
+                  &root->ucaspian__DOT__core__DOT__syn_vld[i], &root->ucaspian__DOT__core__DOT__syn_rdy[i]);
+    for(int i = 0; i < 4; ++i)
+        add_stage("syn_dend_" + std::to_string(i),
+                  &root->ucaspian__DOT__core__DOT__syn_to_dend_vld[i], &root->ucaspian__DOT__core__DOT__syn_to_dend_rdy[i]);
+    add_stage("dend",       &root->ucaspian__DOT__core__DOT__dend_vld,    &root->ucaspian__DOT__core__DOT__dend_rdy);
+    add_stage("output",     &root->ucaspian__DOT__core__DOT__neuron_output_vld, &root->ucaspian__DOT__core__DOT__neuron_output_rdy);
+    add_stage("host_tx",    &top.write_vld, &top.write_rdy);
+
+    for(int i = 0; i < 4; ++i)
+        add_module("synapse_" + std::to_string(i), &root->ucaspian__DOT__core__DOT__syn_step_done[i]);
+    add_module("dendrite",      &root->ucaspian__DOT__core__DOT__dendrite_step_done);
+    add_module("neuron",        &root->ucaspian__DOT__core__DOT__neuron_step_done);
+    add_module("axon",          &root->ucaspian__DOT__core__DOT__axon_step_done);
+    add_module("fire_dispatch", &root->ucaspian__DOT__core__DOT__fd_step_done);
+}
+
+void PipelineProfiler::add_stage(const std::string &name, const uint8_t *vld, const uint8_t *rdy)
+{
+    Stage s;
+    s.name = name;
+    s.vld  = vld;
+    s.rdy  = rdy;
+    m_stages.push_back(s);
+}
+
+void PipelineProfiler::add_module(const std::string &name, const uint8_t *step_done)
+{
+    Module m;
+    m.name      = name;
+    m.step_done = step_done;
+    m_modules.push_back(m);
+}
+
+void PipelineProfiler::sample()
+{
+    if(m_top.reset) return;
+
+    m_cycles++;
+    if(m_top.rootp->ucaspian__DOT__core_active) m_core_active++;
+
+    for(Stage &s : m_stages)
+    {
+        bool vld = *s.vld, rdy = *s.rdy;
+        if(vld && rdy)  s.busy++;
+        else if(vld)    s.stall++;
+        else if(rdy)    s.starved++;
+        else            s.idle++;
+    }
+
+    for(Module &m : m_modules)
+    {
+        if(!*m.step_done) m.working++;
+    }
+}
+
+void PipelineProfiler::write_json(const std::string &fname) const
+{
+    std::ofstream file(fname);
+    if(!file) throw std::runtime_error("Cannot open " + fname);
+
+    file << "{\n";
+    file << "  \"cycles\": " << m_cycles << ",\n";
+    file << "  \"core_active\": " << m_core_active << ",\n";
+
+    file << "  \"stages\": {\n";
+    for(size_t i = 0; i < m_stages.size(); ++i)
+    {
+        const Stage &s = m_stages[i];
+        file << "    \"" << s.name << "\": {\"busy\": " << s.busy << ", \"stall\": " << s.stall
+             << ", \"starved\": " << s.starved << ", \"idle\": " << s.idle << "}"
+             << (i + 1 < m_stages.size() ? "," : "") << "\n";
+    }
+    file << "  },\n";
+
+    file << "  \"modules\": {\n";
+    for(size_t i = 0; i < m_modules.size(); ++i)
+    {
+        const Module &m = m_modules[i];
+        file << "    \"" << m.name << "\": {\"working\": " << m.working << "}"
+             << (i + 1 < m_modules.size() ? "," : "") << "\n";
+    }
+    file << "  }\n";
+    file << "}\n";
+}
@@ -0,0 +1,220 @@
+#include "verilated.h"
+
+#include "simulate.hpp"
+#include "ucaspian_sim.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace
+{
+
+// cycles simulated between checks of the link while the design is busy
+const uint64_t RUN_CHUNK = 4096;
+
+volatile sig_atomic_t stop_requested = 0;
+
+void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+std::runtime_error sys_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + strerror(errno));
+}
+
+/* Remove 'path' if it is a leftover socket / link, never a regular file */
+void remove_stale(const std::string &path, mode_t type)
+{
+    struct stat st;
+    if(lstat(path.c_str(), &st) != 0) return;
+    if((st.st_mode & S_IFMT) != type)
+        throw std::runtime_error(path + " exists and is not a " + (type == S_IFSOCK ? "socket" : "link"));
+    unlink(path.c_str());
+}
+
+int listen_socket(const std::string &path)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Socket path too long: " + path);
+    std::strcpy(addr.sun_path, path.c_str());
+
+    remove_stale(path, S_IFSOCK);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) throw sys_error("socket");
+    if(bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) throw sys_error("bind " + path);
+    if(listen(fd, 1) != 0) throw sys_error("listen " + path);
+
+    return fd;
+}
+
+/* Pseudo-terminal whose slave is linked to 'link'. 'slave' stays open so
+ * the master does not see a hangup while no client has the port open. */
+int open_pty(const std::string &link, int &slave)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) throw sys_error("posix_openpt");
+
+    const char *name = ptsname(fd);
+    slave = open(name, O_RDWR | O_NOCTTY);
+    if(slave < 0) throw sys_error(name);
+
+    // raw bytes until a client sets its own mode, as on a serial port
+    termios tty;
+    tcgetattr(slave, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(slave, TCSANOW, &tty);
+
+    remove_stale(link, S_IFLNK);
+    if(symlink(name, link.c_str()) != 0) throw sys_error("symlink " + link);
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+}
+
+int serve(const std::string &path, bool pty, const SimConfig &cfg)
+{
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = -1, client = -1, slave = -1;
+
+    try
+    {
+        if(pty)
+        {
+            client = open_pty(path, slave);
+            std::cout << "Serving on " << path << " -> " << ptsname(client) << std::endl;
+        }
+        else
+        {
+            listen_fd = listen_socket(path);
+            std::cout << "Serving on " << path << std::endl;
+        }
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // one model for the lifetime of the server, like a board left powered
+    UcaspianSim sim;
+    sim.input_fifo().stall(input_stall(cfg));
+    sim.output_fifo().stall(output_stall(cfg));
+    sim.link(link_timing(cfg));
+    uint64_t idle  = cfg.idle_cycles ? cfg.idle_cycles : 64;
+    uint64_t chunk = std::max(RUN_CHUNK, 2 * idle);
+
+    std::vector<uint8_t> tx;
+    size_t tx_pos = 0;
+    bool   quiet  = false;     // idle design: nothing to do until input arrives
+
+    auto disconnect = [&]()
+    {
+        close(client);
+        client = -1;
+
+        // unread output is lost with the connection
+        tx.clear();
+        tx_pos = 0;
+    };
+
+    while(!stop_requested)
+    {
+        pollfd pfd;
+        if(client >= 0)
+        {
+            pfd.fd     = client;
+            pfd.events = POLLIN | ((tx_pos < tx.size()) ? POLLOUT : 0);
+        }
+        else
+        {
+            pfd.fd     = listen_fd;
+            pfd.events = POLLIN;
+        }
+        pfd.revents = 0;
+
+        // only block while the design has nothing left to do
+        int ready = poll(&pfd, 1, quiet ? -1 : 0);
+        if(ready < 0 && errno != EINTR)
+        {
+            std::cerr << "poll: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if(ready > 0 && client < 0)
+        {
+            client = accept(listen_fd, nullptr, nullptr);
+            if(client >= 0) fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+        }
+        else if(ready > 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            uint8_t buf[4096];
+            ssize_t n = read(client, buf, sizeof(buf));
+            if(n > 0)
+            {
+                sim.write(buf, n);
+                quiet = false;
+            }
+            else if(!pty && (n == 0 || (errno != EAGAIN && errno != EINTR)))
+            {
+                disconnect();
+            }
+        }
+
+        if(!quiet) quiet = sim.run_until_idle(idle, chunk);
+
+        sim.read(tx);
+        if(client < 0)
+        {
+            tx.clear();
+            tx_pos = 0;
+        }
+        else if(tx_pos < tx.size())
+        {
+            ssize_t n = write(client, tx.data() + tx_pos, tx.size() - tx_pos);
+            if(n > 0) tx_pos += n;
+            else if(n < 0 && errno != EAGAIN && errno != EINTR && !pty) disconnect();
+
+            if(tx_pos == tx.size())
+            {
+                tx.clear();
+                tx_pos = 0;
+            }
+        }
+    }
+
+    std::cout << "Stopped after " << sim.cycle() << " cycles" << std::endl;
+
+    if(client >= 0) close(client);
+    if(slave >= 0) close(slave);
+    if(listen_fd >= 0) close(listen_fd);
+    unlink(path.c_str());
+
+    return 0;
+}
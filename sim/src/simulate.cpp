@@ -0,0 +1,213 @@
+#include "verilated.h"
+
+#include "fifo.hpp"
+#include "latency.hpp"
+#include "packets.hpp"
+#include "profile.hpp"
+#include "raster.hpp"
+#include "simulate.hpp"
+#include "ucaspian_sim.hpp"
+#include "uploader.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+// output bytes collected at a time while writing a spike raster
+static const size_t RASTER_CHUNK = 4096;
+
+/* Bytes moved over one host link FIFO and the cycles its stall model held
+ * off a transfer */
+static void report_link(std::ostream &os, const char *name, const ByteFifo &fifo, uint64_t cycles)
+{
+    char line[128];
+    snprintf(line, sizeof(line), "  %s %12llu bytes %12llu stalls %8.4f bytes/cycle", name,
+             (unsigned long long)fifo.transfers(), (unsigned long long)fifo.stalls(),
+             cycles ? double(fifo.transfers()) / cycles : 0.0);
+    os << line << std::endl;
+}
+
+#if VM_TRACE
+/* Offset of the first packet in 'input' starting with 'opcode', or
+ * input.size() if there is none */
+static size_t find_opcode(const std::vector<uint8_t> &input, uint8_t opcode)
+{
+    size_t pos = 0;
+    while(pos < input.size())
+    {
+        if(input[pos] == opcode) return pos;
+
+        size_t size = tx_packet_size(&input[pos], input.size() - pos);
+        if(size == 0) break;
+        pos += size;
+    }
+    return input.size();
+}
+#endif
+
+uint64_t simulate(VerilatedContext &ctx, const std::string &input_file,
+                  const std::string &output_file, const SimConfig &cfg)
+{
+    bool tracing = !cfg.trace_file.empty();
+
+    UcaspianSim sim(&ctx, cfg.trace_file);
+    if(!cfg.restore_file.empty()) sim.restore(cfg.restore_file);
+
+    sim.input_fifo().stall(input_stall(cfg));
+    sim.output_fifo().stall(output_stall(cfg));
+    sim.link(link_timing(cfg));
+
+    // a checkpoint is only taken once the design is quiescent
+    uint64_t idle_cycles = cfg.idle_cycles;
+    if(!cfg.checkpoint_file.empty() && idle_cycles == 0) idle_cycles = 64;
+
+    // Load input -- the host side keeps the 512 byte FIFOs topped up / drained
+    std::vector<uint8_t> input = read_file<uint8_t>(input_file);
+    std::vector<uint8_t> output;
+
+    // with an upload window the host only sends what the credits allow
+    std::unique_ptr<ConfigUploader> uploader;
+    std::vector<uint8_t> sent;
+    if(cfg.upload_window)
+    {
+        uploader.reset(new ConfigUploader(cfg.upload_window));
+        uploader->queue(input.data(), input.size());
+        input = uploader->queued();
+    }
+
+    // cycle each byte crossed the handshake, for the latency profile
+    std::vector<uint64_t> in_stamps, out_stamps;
+    if(!cfg.latency_file.empty())
+    {
+        sim.input_fifo().stamp(&in_stamps);
+        sim.output_fifo().stamp(&out_stamps);
+    }
+
+    std::unique_ptr<PipelineProfiler> profiler;
+    if(!cfg.profile_file.empty()) profiler.reset(new PipelineProfiler(sim.model()));
+
+    // output is decoded into the raster as it is collected
+    std::unique_ptr<RasterWriter> raster;
+    size_t rastered = 0;
+    if(!cfg.raster_file.empty()) raster.reset(new RasterWriter(cfg.raster_file));
+
+    auto collect = [&]()
+    {
+        sim.read(output);
+        if(raster)
+        {
+            raster->feed(output.data() + rastered, output.size() - rastered);
+            rastered = output.size();
+        }
+    };
+
+#if VM_TRACE
+    // cycles to dump, absolute once the trigger opcode (if any) is seen
+    size_t trigger = (tracing && cfg.trace_opcode >= 0) ? find_opcode(input, cfg.trace_opcode) : SIZE_MAX;
+    if(trigger == SIZE_MAX) sim.trace_window(cfg.trace_start, cfg.trace_end);
+    else                    sim.trace_window(UINT64_MAX, UINT64_MAX);
+#else
+    (void)tracing;
+#endif
+
+    if(!uploader) sim.write(input);
+
+    uint64_t steps     = 0;     // cycles run, sim.cycle() after each tick
+    uint64_t last_busy = 0;
+    uint64_t out_seen  = 0;
+
+    while(!ctx.gotFinish())
+    {
+#if VM_TRACE
+        // input bytes handed to the design so far
+        if(sim.consumed() > trigger)
+        {
+            uint64_t now = sim.cycle();
+            trigger = SIZE_MAX;
+            sim.trace_window((UINT64_MAX - now > cfg.trace_start) ? now + cfg.trace_start : UINT64_MAX,
+                             (UINT64_MAX - now > cfg.trace_end)   ? now + cfg.trace_end   : UINT64_MAX);
+        }
+#endif
+
+        sim.tick();
+        steps = sim.cycle();
+
+        if(profiler) profiler->sample();
+
+        if(uploader)
+        {
+            // return credit for every response, then send what fits
+            size_t old = output.size();
+            collect();
+            uploader->receive(output.data() + old, output.size() - old);
+
+            sent.clear();
+            uploader->send(sent);
+            if(sent.size() > sim.input_fifo().space())
+                throw std::runtime_error("RX FIFO overflow, upload window is larger than the FIFO");
+            sim.write(sent);
+        }
+        else if(raster && sim.available() >= RASTER_CHUNK)
+        {
+            collect();
+        }
+
+        if(idle_cycles)
+        {
+            uint64_t out_total = sim.produced();
+
+            bool busy = sim.busy() || (uploader && !uploader->idle()) || out_total != out_seen;
+
+            out_seen = out_total;
+
+            if(busy) last_busy = steps;
+            else if(steps - last_busy >= idle_cycles)
+            {
+                steps = last_busy;
+                break;
+            }
+        }
+
+        if(steps > cfg.max_steps) break;
+    }
+
+    // write output
+    collect();
+    write_file(output_file, output);
+    if(raster) raster->close();
+
+    if(!cfg.checkpoint_file.empty())
+    {
+        if(steps > cfg.max_steps)
+            throw std::runtime_error("Not quiescent after " + std::to_string(cfg.max_steps) +
+                                     " cycles, no checkpoint saved");
+        sim.save(cfg.checkpoint_file);
+    }
+
+    if(!cfg.latency_file.empty())
+    {
+        LatencyProfile profile(input, in_stamps, output, out_stamps);
+        profile.write_csv(cfg.latency_file);
+        profile.report(std::cout);
+    }
+
+    if(profiler) profiler->write_json(cfg.profile_file);
+
+    if(cfg.link_report && (!cfg.stall_in.empty() || !cfg.stall_out.empty()))
+    {
+        std::cout << "Link throughput over " << steps << " cycles" << std::endl;
+        report_link(std::cout, "RX", sim.input_fifo(), steps);
+        report_link(std::cout, "TX", sim.output_fifo(), steps);
+    }
+
+    if(cfg.link_report && !cfg.link.empty())
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "Estimated %.3f ms on %s (%.1f MHz sys_clk)", 1e3 * steps / cfg.clock_hz,
+                 cfg.link.c_str(), cfg.clock_hz / 1e6);
+        std::cout << line << std::endl;
+    }
+
+    return steps;
+}
@@ -1,88 +1,181 @@
-#include "Vucaspian.h"
 #include "verilated.h"
-#include "verilated_fst_c.h"
 
-#include "fifo.hpp"
+#include "simulate.hpp"
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
+
+static void usage(const char *prog)
+{
+    std::cerr << "Usage: " << prog << " [options] input_file output_file (max_steps) (trace_file) (rand_io)" << std::endl;
+    std::cerr << "       " << prog << " [options] --batch manifest_file (threads) (max_steps)" << std::endl;
+    std::cerr << "       " << prog << " [options] --serve socket_path | --pty link_path" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --idle cycles            stop once quiescent for this many cycles" << std::endl;
+    std::cerr << "  --upload window          send the input with credit based flow control" << std::endl;
+    std::cerr << "  --no-trace               do not write a waveform trace" << std::endl;
+    std::cerr << "  --trace-window start end only trace cycles [start, end)" << std::endl;
+    std::cerr << "  --trace-opcode opcode    start the trace window at the first packet with this opcode" << std::endl;
+    std::cerr << "  --latency csv_file       write per-event FIRE/STEP latencies and print percentiles" << std::endl;
+    std::cerr << "  --profile json_file      write per-stage pipeline utilization" << std::endl;
+    std::cerr << "  --raster raster_file     stream the output fires to a binary spike raster" << std::endl;
+    std::cerr << "  --stall-in model         host link stalls on the RX FIFO: none, bernoulli:p," << std::endl;
+    std::cerr << "                           burst:on:off, or duty:period:ready" << std::endl;
+    std::cerr << "  --stall-out model        host link stalls on the TX FIFO" << std::endl;
+    std::cerr << "  --seed n                 seed of the random stall models" << std::endl;
+    std::cerr << "  --link profile           pace the FIFOs like a board's host link: upduino_uart_top," << std::endl;
+    std::cerr << "                           upduinolp_top, upduino_spi_top, uart:baud, or" << std::endl;
+    std::cerr << "                           spi:sck_hz(:depth(:gap_ns))" << std::endl;
+    std::cerr << "  --clock hz               system clock the link is paced against (24 MHz)" << std::endl;
+    std::cerr << "  --checkpoint file        save the model once the input is consumed and it is quiescent" << std::endl;
+    std::cerr << "  --restore file           restore a checkpoint before sending the input" << std::endl;
+    exit(1);
+}
 
 int main(int argc, char **argv, char **env)
 {
-    std::string trace_name = "trace.fst";
-    uint64_t max_steps = 8192;
-    uint64_t steps = 0;
-    int rand_io = 0;
+    SimConfig cfg;
+    cfg.trace_file = "trace.fst";
+    bool batch = false;
+    bool pty = false;
+    std::string serve_path;
+    bool no_trace = false;
 
     //Verilated::commandArgs(argc, argv);
-    
-    if(argc < 3)
+
+    // options may appear anywhere, everything else is positional
+    std::vector<std::string> args;
+    for(int i = 1; i < argc; ++i)
     {
-        std::cerr << "Usage: " << argv[0] << " input_file output_file (max_steps) (trace_file) (rand_io)" << std::endl;
-        exit(1);
+        if(strcmp(argv[i], "--batch") == 0)
+            batch = true;
+        else if(strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serve_path = argv[++i];
+        else if(strcmp(argv[i], "--pty") == 0 && i + 1 < argc)
+        {
+            serve_path = argv[++i];
+            pty = true;
+        }
+        else if(strcmp(argv[i], "--idle") == 0 && i + 1 < argc)
+            cfg.idle_cycles = strtoull(argv[++i], nullptr, 0);
+        else if(strcmp(argv[i], "--upload") == 0 && i + 1 < argc)
+            cfg.upload_window = strtoull(argv[++i], nullptr, 0);
+        else if(strcmp(argv[i], "--no-trace") == 0)
+            no_trace = true;
+        else if(strcmp(argv[i], "--trace-window") == 0 && i + 2 < argc)
+        {
+            cfg.trace_start = strtoull(argv[++i], nullptr, 0);
+            cfg.trace_end   = strtoull(argv[++i], nullptr, 0);
+        }
+        else if(strcmp(argv[i], "--trace-opcode") == 0 && i + 1 < argc)
+            cfg.trace_opcode = strtol(argv[++i], nullptr, 0) & 0xFF;
+        else if(strcmp(argv[i], "--latency") == 0 && i + 1 < argc)
+            cfg.latency_file = argv[++i];
+        else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            cfg.profile_file = argv[++i];
+        else if(strcmp(argv[i], "--raster") == 0 && i + 1 < argc)
+            cfg.raster_file = argv[++i];
+        else if(strcmp(argv[i], "--stall-in") == 0 && i + 1 < argc)
+            cfg.stall_in = argv[++i];
+        else if(strcmp(argv[i], "--stall-out") == 0 && i + 1 < argc)
+            cfg.stall_out = argv[++i];
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            cfg.stall_seed = strtoull(argv[++i], nullptr, 0);
+        else if(strcmp(argv[i], "--link") == 0 && i + 1 < argc)
+            cfg.link = argv[++i];
+        else if(strcmp(argv[i], "--clock") == 0 && i + 1 < argc)
+            cfg.clock_hz = strtoull(argv[++i], nullptr, 0);
+        else if(strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+            cfg.checkpoint_file = argv[++i];
+        else if(strcmp(argv[i], "--restore") == 0 && i + 1 < argc)
+            cfg.restore_file = argv[++i];
+        else if(strncmp(argv[i], "--", 2) == 0)
+            usage(argv[0]);
+        else
+            args.push_back(argv[i]);
     }
 
-    // input packets & output packets from cmd line arguments
-    std::string input_file = argv[1];
-    std::string output_file = argv[2];
-
-    if(argc >= 4)
-        max_steps = atoi(argv[3]);
+    if(cfg.clock_hz == 0) usage(argv[0]);
 
-    if(argc >= 5)
-        trace_name = argv[4];
-
-    if(argc >= 6)
-        rand_io = atoi(argv[5]);
+    // reject a bad stall model or link before any run starts
+    try
+    {
+        input_stall(cfg);
+        output_stall(cfg);
+        link_timing(cfg);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
-    if(rand_io > 0)
-        srand(rand_io);
+    if(!serve_path.empty())
+    {
+        // persistent model behind a socket or pty, never traced
+        return serve(serve_path, pty, cfg);
+    }
 
-    Vucaspian top;
+    if(batch)
+    {
+        if(args.size() < 1) usage(argv[0]);
 
-    ByteFifo fifo_in (&(top.sys_clk), &(top.read_rdy),  &(top.read_vld),  &(top.read_data),  true,  (rand_io != 0));
-    ByteFifo fifo_out(&(top.sys_clk), &(top.write_rdy), &(top.write_vld), &(top.write_data), false, (rand_io != 0));
+        // many runs on a pool of worker threads
+        unsigned jobs = (args.size() >= 2) ? atoi(args[1].c_str()) : 0;
+        if(args.size() >= 3) cfg.max_steps = strtoull(args[2].c_str(), nullptr, 0);
 
-    // Load input
-    fifo_in.push_from_file(input_file);
+        return (simulate_batch(args[0], jobs, cfg) == 0) ? 0 : 1;
+    }
 
-    // logging to fst file for viewing in GtkWave
-    Verilated::traceEverOn(true);
-    VerilatedFstC fst;
-    top.trace(&fst, 99);
-    fst.open(trace_name.c_str());
+    if(args.size() < 2) usage(argv[0]);
 
-    // Initialize ports
-    top.sys_clk = 1;
-    top.reset = 1;
-    
-    while(!Verilated::gotFinish())
-    {
-        if(steps > 2) top.reset = 0;
+    // input packets & output packets from cmd line arguments
+    const std::string &input_file = args[0];
+    const std::string &output_file = args[1];
 
-        for(int c = 0; c < 2; ++c)
-        {
-            fst.dump(2*steps+c);
+    if(args.size() >= 3)
+        cfg.max_steps = strtoull(args[2].c_str(), nullptr, 0);
 
-            top.sys_clk = !top.sys_clk;
+    if(args.size() >= 4)
+        cfg.trace_file = args[3];
 
-            // update design
-            top.eval();
+    // rand_io: stall both links at random with this seed (0 = off)
+    if(args.size() >= 5 && atoi(args[4].c_str()) > 0)
+    {
+        cfg.stall_seed = atoi(args[4].c_str());
+        if(cfg.stall_in.empty())  cfg.stall_in  = "bernoulli:0.5";
+        if(cfg.stall_out.empty()) cfg.stall_out = "bernoulli:0.5";
+    }
 
-            // update fifos on rising edge
-            fifo_in.eval(top.sys_clk, top.reset);
-            fifo_out.eval(top.sys_clk, top.reset);
-        }
+    if(no_trace)
+        cfg.trace_file.clear();
 
-        if(steps > max_steps) break;
+    VerilatedContext ctx;
+    uint64_t cycles = 0;
 
-        steps++;
+    try
+    {
+        cycles = simulate(ctx, input_file, output_file, cfg);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
     }
 
-    // write output
-    fifo_out.pop_to_file(output_file);
-
-    fst.close();
+    if(!cfg.checkpoint_file.empty())
+        std::cout << "Checkpoint saved to " << cfg.checkpoint_file << " after " << cycles << " cycles" << std::endl;
+    else if(cfg.idle_cycles)
+    {
+        if(cycles > cfg.max_steps)
+            std::cout << "Not quiescent after " << cfg.max_steps << " cycles" << std::endl;
+        else
+            std::cout << "Quiescent after " << cycles << " cycles" << std::endl;
+    }
 
     return 0;
 }
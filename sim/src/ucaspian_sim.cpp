@@ -0,0 +1,285 @@
+#include "Vucaspian.h"
+#include "Vucaspian___024root.h"
+#include "verilated.h"
+#if UCASPIAN_SAVABLE
+#include "verilated_save.h"
+#endif
+#if VM_TRACE
+#include "verilated_fst_c.h"
+#endif
+
+#include "ucaspian_sim.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+/* traceEverOn must be set before the model is built */
+static Vucaspian *new_model(VerilatedContext *ctx, bool tracing)
+{
+    ctx->traceEverOn(tracing);
+    return new Vucaspian(ctx);
+}
+
+UcaspianSim::UcaspianSim(VerilatedContext *ctx, const std::string &trace_file) :
+    m_own_ctx(ctx ? nullptr : new VerilatedContext),
+    m_ctx(ctx ? ctx : m_own_ctx.get()),
+    m_top(new_model(m_ctx, VM_TRACE && !trace_file.empty())),
+    m_fifo_in (&(m_top->sys_clk), &(m_top->read_rdy),  &(m_top->read_vld),  &(m_top->read_data),  true),
+    m_fifo_out(&(m_top->sys_clk), &(m_top->write_rdy), &(m_top->write_vld), &(m_top->write_data), false)
+{
+#if VM_TRACE
+    // logging to fst file for viewing in GtkWave
+    if(!trace_file.empty())
+    {
+        m_fst = new VerilatedFstC;
+        m_top->trace(m_fst, 99);
+        m_fst->open(trace_file.c_str());
+    }
+#else
+    if(!trace_file.empty())
+        std::cerr << "Model built without tracing, ignoring " << trace_file << std::endl;
+#endif
+
+    // Initialize ports
+    m_top->sys_clk = 1;
+    m_top->reset = 1;
+}
+
+UcaspianSim::~UcaspianSim()
+{
+#if VM_TRACE
+    if(m_fst)
+    {
+        m_fst->close();
+        delete m_fst;
+    }
+#endif
+    m_top->final();
+}
+
+void UcaspianSim::write(const uint8_t *data, size_t len)
+{
+    // straight into the FIFO while nothing is queued ahead
+    if(m_input_pos == m_input.size())
+    {
+        size_t n = m_fifo_in.push(Span<const uint8_t>(data, len));
+        m_pushed += n;
+        data += n;
+        len  -= n;
+
+        m_input.clear();
+        m_input_pos = 0;
+    }
+    else if(m_input_pos >= m_input.size() / 2)
+    {
+        m_input.erase(m_input.begin(), m_input.begin() + m_input_pos);
+        m_input_pos = 0;
+    }
+
+    m_input.insert(m_input.end(), data, data + len);
+}
+
+size_t UcaspianSim::read(uint8_t *data, size_t len)
+{
+    drain_output();
+
+    size_t n = std::min(len, m_output.size() - m_output_pos);
+    std::memcpy(data, m_output.data() + m_output_pos, n);
+    m_output_pos += n;
+
+    if(m_output_pos == m_output.size())
+    {
+        m_output.clear();
+        m_output_pos = 0;
+    }
+
+    return n;
+}
+
+size_t UcaspianSim::read(std::vector<uint8_t> &out)
+{
+    drain_output();
+
+    size_t n = m_output.size() - m_output_pos;
+    out.insert(out.end(), m_output.begin() + m_output_pos, m_output.end());
+    m_output.clear();
+    m_output_pos = 0;
+
+    return n;
+}
+
+size_t UcaspianSim::available() const
+{
+    return m_output.size() - m_output_pos + m_fifo_out.landed();
+}
+
+void UcaspianSim::drain_output()
+{
+    m_popped += m_fifo_out.pop_all(m_output);
+}
+
+void UcaspianSim::run(uint64_t cycles)
+{
+    for(uint64_t i = 0; i < cycles && !m_ctx->gotFinish(); ++i)
+        tick();
+}
+
+bool UcaspianSim::run_until_idle(uint64_t idle_cycles, uint64_t max_cycles)
+{
+    uint64_t seen = produced();
+    m_last_busy = m_cycle;
+
+    for(uint64_t i = 0; i < max_cycles && !m_ctx->gotFinish(); ++i)
+    {
+        tick();
+
+        uint64_t out = produced();
+        if(busy() || out != seen) m_last_busy = m_cycle;
+        else if(m_cycle - m_last_busy >= idle_cycles) return true;
+        seen = out;
+    }
+
+    return false;
+}
+
+void UcaspianSim::reset()
+{
+    m_input.clear();
+    m_input_pos = 0;
+    m_output.clear();
+    m_output_pos = 0;
+    m_pushed = 0;
+    m_popped = 0;
+
+    m_fifo_in.clear();
+    m_fifo_out.clear();
+    m_link.restart();
+
+    m_top->reset = 1;
+    m_reset_left = 3;
+}
+
+void UcaspianSim::tick()
+{
+    m_top->reset = (m_reset_left > 0);
+    if(m_reset_left > 0) m_reset_left--;
+
+    for(int c = 0; c < 2; ++c)
+    {
+#if VM_TRACE
+        if(m_fst && m_cycle >= m_trace_start && m_cycle < m_trace_end) m_fst->dump(2*m_cycle+c);
+#endif
+
+        m_top->sys_clk = !m_top->sys_clk;
+
+        // update design
+        m_top->eval();
+
+        // update fifos on rising edge
+        m_fifo_in.eval(m_top->sys_clk, m_top->reset, m_cycle);
+        m_fifo_out.eval(m_top->sys_clk, m_top->reset, m_cycle);
+    }
+
+    if(m_link.active()) m_link.eval(m_fifo_in, m_fifo_out);
+
+    // move host data in bulk once half a FIFO is free / full
+    if(m_input_pos < m_input.size() && m_fifo_in.space() >= ByteFifo::capacity / 2)
+    {
+        size_t n = m_fifo_in.push(Span<const uint8_t>(m_input.data() + m_input_pos, m_input.size() - m_input_pos));
+        m_input_pos += n;
+        m_pushed    += n;
+    }
+
+    if(m_fifo_out.landed() >= ByteFifo::capacity / 2)
+        drain_output();
+
+    m_cycle++;
+}
+
+bool UcaspianSim::busy() const
+{
+    // internal signals made public by sim/ucaspian.vlt
+    const Vucaspian___024root *root = m_top->rootp;
+
+    return m_top->reset
+        || m_input_pos < m_input.size() || !m_fifo_in.empty() || m_top->read_vld
+        || m_fifo_out.in_flight() > 0
+        || root->ucaspian__DOT__core_active
+        || !root->ucaspian__DOT__core__DOT__step_done
+        || !root->ucaspian__DOT__core__DOT__step_done_hold;
+}
+
+#if UCASPIAN_SAVABLE
+void UcaspianSim::save(const std::string &fname)
+{
+    if(m_input_pos < m_input.size() || !m_fifo_in.empty())
+        throw std::runtime_error("Cannot checkpoint before all input is consumed");
+    if(m_fifo_out.in_flight() > 0)
+        throw std::runtime_error("Cannot checkpoint while output is crossing the host link");
+
+    drain_output();
+
+    VerilatedSave os;
+    os.open(fname.c_str());
+    if(!os.isOpen()) throw std::runtime_error("Cannot open " + fname);
+
+    uint32_t reset_left = m_reset_left;
+    uint64_t unread     = m_output.size() - m_output_pos;
+    os << reset_left << unread;
+    os.write(m_output.data() + m_output_pos, unread);
+    os << *m_top;
+    os.close();
+}
+
+void UcaspianSim::restore(const std::string &fname)
+{
+    VerilatedRestore is;
+    is.open(fname.c_str());
+    if(!is.isOpen()) throw std::runtime_error("Cannot open " + fname);
+
+    uint32_t reset_left;
+    uint64_t unread;
+    is >> reset_left >> unread;
+    m_reset_left = reset_left;
+    m_output.resize(unread);
+    is.read(m_output.data(), unread);
+    is >> *m_top;
+    is.close();
+
+    m_input.clear();
+    m_input_pos  = 0;
+    m_output_pos = 0;
+    m_fifo_in.clear();
+    m_fifo_out.clear();
+    m_link.restart();
+
+    m_pushed    = 0;
+    m_popped    = unread;
+    m_cycle     = 0;
+    m_last_busy = 0;
+}
+#else
+void UcaspianSim::save(const std::string &)
+{
+    throw std::runtime_error("Model built without --savable, see make test-savable");
+}
+
+void UcaspianSim::restore(const std::string &)
+{
+    throw std::runtime_error("Model built without --savable, see make test-savable");
+}
+#endif
+
+void UcaspianSim::link(const LinkTiming &timing)
+{
+    m_link = timing;
+    m_link.attach(m_fifo_in, m_fifo_out);
+}
+
+void UcaspianSim::trace_window(uint64_t start, uint64_t end)
+{
+    m_trace_start = start;
+    m_trace_end   = end;
+}
@@ -0,0 +1,57 @@
+#include "network.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    bool clear = (argc >= 2 && strcmp(argv[1], "--clear") == 0);
+    int  arg   = clear ? 2 : 1;
+
+    if(argc < arg + 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " [--clear] network_file output_file" << std::endl;
+        exit(1);
+    }
+
+    Network net;
+    Layout  layout;
+
+    try
+    {
+        net    = read_network(argv[arg]);
+        layout = compile_network(net);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
+
+    std::vector<uint8_t> output;
+
+    if(clear)
+    {
+        uint8_t buf[TX_CLEAR_SIZE];
+        output.insert(output.end(), buf, buf + tx_clear_cfg(buf));
+    }
+
+    encode_layout(layout, output);
+    size_t config_size = output.size();
+
+    output.insert(output.end(), net.commands.begin(), net.commands.end());
+
+    std::ofstream output_file(argv[arg + 1], std::ios::binary);
+    output_file.write(reinterpret_cast<const char *>(output.data()), output.size());
+
+    // one packet per neuron & synapse for comparison
+    size_t naive = layout.neurons.size() * TX_CFG_N_SIZE + layout.synapses.size() * TX_CFG_SYN_SIZE;
+
+    std::cerr << layout.neurons.size() << " neurons, " << layout.synapses.size() << " synapses, "
+              << config_size << " config bytes (" << naive << " as single packets)" << std::endl;
+
+    return 0;
+}
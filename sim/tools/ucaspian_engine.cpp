@@ -0,0 +1,37 @@
+#include "engine.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " input_file output_file" << std::endl;
+        exit(1);
+    }
+
+    // input packets & output packets from cmd line arguments
+    std::ifstream input_file(argv[1], std::ios::binary);
+    if(!input_file)
+    {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        exit(1);
+    }
+
+    std::vector<uint8_t> input((std::istreambuf_iterator<char>(input_file)),
+                                std::istreambuf_iterator<char>());
+    std::vector<uint8_t> output;
+
+    UcaspianEngine engine;
+    engine.process(input.data(), input.size(), output);
+
+    // write output
+    std::ofstream output_file(argv[2], std::ios::binary);
+    output_file.write(reinterpret_cast<const char *>(output.data()), output.size());
+
+    return 0;
+}
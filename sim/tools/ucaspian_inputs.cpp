@@ -0,0 +1,136 @@
+/* Dense input benchmark
+ *
+ * Generates a random network and a run of timesteps in which each of 128
+ * inputs fires with a given probability, as an image or DVS frame would,
+ * and writes packet files stimulating it:
+ *
+ *   fire_file, fires_file, map_file
+ *       inputs 0-127 as one Input Fire packet per spike, one Input Fires
+ *       packet per timestep, and one Input Fire Bitmap per timestep
+ *   wrap_fires_file, wrap_map_file (optional)
+ *       inputs 192-255 and 0-63, out of reach of Input Fire, as Input Fires
+ *       and as an Input Fire Bitmap from FIRST = 192 that wraps at 256
+ *
+ * Every file of a stimulus is run through the reference engine to check
+ * they produce the same spikes. scripts/bench_inputs.py times the first
+ * three on the Verilator model.
+ */
+
+#include "fifo.hpp"
+#include "workload.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static const int NEURONS = 256;
+static const int INPUTS  = 128;     // per timestep
+static const int OUTPUTS = 16;
+static const int VALUE   = 32;
+static const int WRAP_FIRST = 192;
+
+static const RandomShape SHAPE = { NEURONS, OUTPUTS, 127, INPUTS, false };
+
+struct Stimulus
+{
+    std::vector<uint8_t> single, fires, map;
+    uint64_t spikes = 0;
+};
+
+/* 'timesteps' frames over inputs first .. first + 127 (mod 256), each
+ * appended to the files after 'config'. 'single' stays empty unless every
+ * input is below 128. */
+static Stimulus frames(const std::vector<uint8_t> &config, int first, int timesteps, double density, std::mt19937 &rng)
+{
+    std::bernoulli_distribution fires_now(density);
+    bool low = (first + INPUTS <= 128);
+
+    Stimulus st;
+    st.single = low ? config : std::vector<uint8_t>();
+    st.fires  = config;
+    st.map    = config;
+
+    for(int t = 0; t < timesteps; ++t)
+    {
+        bool      fire[INPUTS];
+        InputFire batch[INPUTS];
+        int       count = 0;
+
+        for(int i = 0; i < INPUTS; ++i)
+        {
+            fire[i] = fires_now(rng);
+            if(fire[i]) batch[count++] = {uint8_t(first + i), uint8_t(VALUE)};
+        }
+        st.spikes += count;
+
+        uint8_t pck[TX_FIRE_SIZE];
+        for(int i = 0; low && i < count; ++i)
+            st.single.insert(st.single.end(), pck, pck + tx_input_fire(pck, batch[i].id, batch[i].value));
+
+        uint8_t fires_pck[tx_input_fires_size(INPUTS)];
+        st.fires.insert(st.fires.end(), fires_pck, fires_pck + tx_input_fires(fires_pck, batch, count));
+
+        uint8_t map_pck[tx_input_fire_map_size(INPUTS)];
+        st.map.insert(st.map.end(), map_pck, map_pck + tx_input_fire_map(map_pck, VALUE, first, INPUTS, fire));
+
+        uint8_t step[TX_STEP_SIZE];
+        tx_step(step, 1);
+        if(low) st.single.insert(st.single.end(), step, step + TX_STEP_SIZE);
+        st.fires.insert(st.fires.end(), step, step + TX_STEP_SIZE);
+        st.map.insert(st.map.end(), step, step + TX_STEP_SIZE);
+    }
+
+    return st;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " fire_file fires_file map_file (timesteps) (density) (seed)"
+                  << " (wrap_fires_file wrap_map_file)" << std::endl;
+        exit(1);
+    }
+
+    int      timesteps = (argc >= 5) ? atoi(argv[4]) : 1000;
+    double   density   = (argc >= 6) ? atof(argv[5]) : 0.25;
+    unsigned seed      = (argc >= 7) ? atoi(argv[6]) : 1;
+
+    std::mt19937 rng(seed);
+
+    // the same configuration starts every file
+    std::vector<uint8_t> config;
+    uint8_t buf[TX_CLEAR_SIZE];
+    config.insert(config.end(), buf, buf + tx_clear_cfg(buf));
+    encode_layout(compile_network(random_network(rng, SHAPE)), config);
+
+    Stimulus low  = frames(config, 0, timesteps, density, rng);
+    Stimulus wrap = frames(config, WRAP_FIRST, timesteps, density, rng);
+
+    write_file(argv[1], low.single);
+    write_file(argv[2], low.fires);
+    write_file(argv[3], low.map);
+    if(argc >= 9)
+    {
+        write_file(argv[7], wrap.fires);
+        write_file(argv[8], wrap.map);
+    }
+
+    auto report = [&](const char *name, const std::vector<uint8_t> &f) {
+        size_t bytes = f.size() - config.size();
+        std::cout << name << bytes << " input bytes, " << double(bytes) / timesteps << " per timestep" << std::endl;
+    };
+
+    std::cout << timesteps << " timesteps, " << low.spikes << " input spikes, "
+              << config.size() << " config bytes" << std::endl;
+    report("input fire:   ", low.single);
+    report("input fires:  ", low.fires);
+    report("fire bitmap:  ", low.map);
+
+    // every encoding must drive the network the same way
+    bool match = check_engine("reference engine", {&low.single, &low.fires, &low.map});
+    match = check_engine("inputs 192-255, 0-63", {&wrap.fires, &wrap.map}) && match;
+
+    return match ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/* Differential reconfiguration benchmark
+ *
+ * Generates a random network followed by a chain of mutated children, as an
+ * evolutionary search would, and writes two packet files evaluating every
+ * network: one reloading the full configuration after Clear Configuration,
+ * one sending only the delta computed by ConfigShadow. Both files are run
+ * through the reference engine to check they produce the same spikes.
+ * scripts/bench_reconfig.py times both files on the Verilator model.
+ */
+
+#include "fifo.hpp"
+#include "shadow.hpp"
+#include "workload.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static const int NEURONS = 64;
+static const int INPUTS  = 8;
+static const int OUTPUTS = 8;
+static const int STEPS   = 32;
+
+static const RandomShape SHAPE = { NEURONS, OUTPUTS, 63, 0, true };
+
+static void mutate(Network &net, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<int> op(0, 3), neuron(0, NEURONS - 1), weight(-32, 96);
+
+    switch(op(rng))
+    {
+        case 0:
+            net.neurons[neuron(rng)].threshold = std::uniform_int_distribution<int>(0, 63)(rng);
+            break;
+        case 1:
+            net.synapses.push_back({uint8_t(neuron(rng)), uint8_t(neuron(rng)), int8_t(weight(rng))});
+            break;
+        case 2:
+            if(!net.synapses.empty())
+                net.synapses.erase(net.synapses.begin() + rng() % net.synapses.size());
+            break;
+        default:
+            if(!net.synapses.empty())
+                net.synapses[rng() % net.synapses.size()].weight = weight(rng);
+            break;
+    }
+}
+
+/* Evaluate the current configuration from a clean activity state */
+static void append_eval(std::vector<uint8_t> &out)
+{
+    uint8_t buf[TX_FIRE_SIZE];
+
+    out.insert(out.end(), buf, buf + tx_clear_act(buf));
+    for(int i = 0; i < INPUTS; ++i)
+        out.insert(out.end(), buf, buf + tx_input_fire(buf, i, 255));
+    out.insert(out.end(), buf, buf + tx_step(buf, STEPS));
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " full_file diff_file (networks) (seed)" << std::endl;
+        exit(1);
+    }
+
+    int      networks = (argc >= 4) ? atoi(argv[3]) : 1000;
+    unsigned seed     = (argc >= 5) ? atoi(argv[4]) : 1;
+
+    std::mt19937 rng(seed);
+    Network net = random_network(rng, SHAPE);
+
+    std::vector<uint8_t> full, diff;
+    size_t full_cfg = 0, diff_cfg = 0;
+    ConfigShadow shadow;
+
+    for(int i = 0; i < networks; ++i)
+    {
+        if(i > 0)
+        {
+            int mutations = 1 + rng() % 3;
+            for(int m = 0; m < mutations; ++m) mutate(net, rng);
+        }
+
+        size_t old = full.size();
+        uint8_t buf[TX_CLEAR_SIZE];
+        full.insert(full.end(), buf, buf + tx_clear_cfg(buf));
+        encode_layout(compile_network(net), full);
+        full_cfg += full.size() - old;
+
+        diff_cfg += shadow.load(net, diff);
+
+        append_eval(full);
+        append_eval(diff);
+    }
+
+    write_file(argv[1], full);
+    write_file(argv[2], diff);
+
+    std::cout << networks << " networks" << std::endl;
+    std::cout << "full reload:  " << full_cfg << " config bytes, " << full.size() << " total" << std::endl;
+    std::cout << "differential: " << diff_cfg << " config bytes, " << diff.size() << " total" << std::endl;
+
+    // both uploads must leave the same network behind
+    return check_engine("reference engine", {&full, &diff}) ? 0 : 1;
+}
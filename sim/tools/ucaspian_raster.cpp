@@ -0,0 +1,57 @@
+/* Spike raster conversion
+ *
+ * Converts a raw uCaspian -> host output file (as written by Vucaspian or
+ * ucaspian_upload) to the binary spike raster of raster.hpp, or dumps a
+ * raster as "epoch time neuron" lines.
+ */
+
+#include "fifo.hpp"
+#include "raster.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    bool dump = (argc == 3 && strcmp(argv[1], "--dump") == 0);
+    if(!dump && argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " output_file raster_file (block_size)" << std::endl;
+        std::cerr << "       " << argv[0] << " --dump raster_file" << std::endl;
+        exit(1);
+    }
+
+    try
+    {
+        if(dump)
+        {
+            RasterReader raster(argv[2]);
+            raster.for_each([](uint32_t epoch, uint32_t time, uint8_t neuron) {
+                std::cout << epoch << ' ' << time << ' ' << int(neuron) << '\n';
+            });
+            return 0;
+        }
+
+        uint32_t block_size = (argc >= 4) ? atoi(argv[3]) : RasterWriter::DEFAULT_BLOCK;
+        std::vector<uint8_t> output = read_file<uint8_t>(argv[1]);
+
+        RasterWriter raster(argv[2], block_size);
+        raster.feed(output.data(), output.size());
+        raster.close();
+
+        RasterReader check(argv[2]);
+        const RasterHeader &h = check.header();
+        std::cout << h.spikes << " spikes in " << h.blocks << " blocks, " << h.epochs << " epochs, "
+                  << output.size() << " -> " << h.index_offset + h.blocks * sizeof(RasterIndexEntry)
+                  << " bytes" << std::endl;
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+/* Upload a packet file to uCaspian over a serial port
+ *
+ * The device may also be the Unix socket of a `Vucaspian --serve` simulator.
+ *
+ * Packets are sent through a ConfigUploader, so up to 'window' bytes are in
+ * flight instead of waiting for every ack like scripts/ucaspian.py. Responses
+ * are written to output_file until the link has been quiet for 0.33 s after
+ * the last expected response.
+ */
+
+#include "fifo.hpp"
+#include "uploader.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+static speed_t baud_rate(long baud)
+{
+    switch(baud)
+    {
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 921600:  return B921600;
+        case 1000000: return B1000000;
+        case 2000000: return B2000000;
+        case 3000000: return B3000000;
+        default:
+            std::cerr << "Unsupported baud rate " << baud << std::endl;
+            exit(1);
+    }
+}
+
+static int open_socket(const char *path)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        std::cerr << "Cannot connect to " << path << ": " << strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    return fd;
+}
+
+static int open_serial(const char *device, long baud)
+{
+    struct stat st;
+    if(stat(device, &st) == 0 && S_ISSOCK(st.st_mode)) return open_socket(device);
+
+    int fd = open(device, O_RDWR | O_NOCTTY);
+    if(fd < 0)
+    {
+        std::cerr << "Cannot open " << device << ": " << strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    termios tty;
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, baud_rate(baud));
+    cfsetospeed(&tty, baud_rate(baud));
+    tty.c_cc[VMIN]  = 0;
+    tty.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tty);
+    tcflush(fd, TCIOFLUSH);
+
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " device input_file output_file (window) (baud)" << std::endl;
+        exit(1);
+    }
+
+    size_t window = (argc >= 5) ? strtoul(argv[4], nullptr, 0) : 512;
+    long   baud   = (argc >= 6) ? strtol(argv[5], nullptr, 0) : 3000000;
+
+    std::vector<uint8_t> input = read_file<uint8_t>(argv[2]);
+    std::vector<uint8_t> output, sent;
+
+    ConfigUploader uploader(window);
+    uploader.queue(input.data(), input.size());
+
+    int fd = open_serial(argv[1], baud);
+    auto start = std::chrono::steady_clock::now();
+
+    const int quiet_ms = 330;
+    const int stall_ms = 5000;
+    size_t written = 0;
+    int waited = 0;
+
+    for(;;)
+    {
+        uploader.send(sent);
+        if(written < sent.size())
+        {
+            ssize_t n = write(fd, sent.data() + written, sent.size() - written);
+            if(n < 0)
+            {
+                std::cerr << "Write failed: " << strerror(errno) << std::endl;
+                exit(1);
+            }
+            written += n;
+        }
+
+        pollfd pfd = { fd, POLLIN, 0 };
+        int timeout = (written < sent.size()) ? 0 : (uploader.idle() ? quiet_ms : 100);
+        if(poll(&pfd, 1, timeout) <= 0)
+        {
+            if(uploader.idle()) break;
+
+            waited += timeout;
+            if(waited >= stall_ms)
+            {
+                std::cerr << "No response for " << stall_ms / 1000.0 << " s, "
+                          << uploader.pending() << " packets not sent" << std::endl;
+                exit(1);
+            }
+            continue;
+        }
+        waited = 0;
+
+        uint8_t buf[4096];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n <= 0) continue;
+
+        output.insert(output.end(), buf, buf + n);
+        uploader.receive(buf, n);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    close(fd);
+
+    write_file(argv[3], output);
+
+    std::cout << sent.size() << " bytes sent, " << output.size() << " received, "
+              << elapsed.count() << " s (includes " << quiet_ms / 1000.0 << " s quiet time)" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <stdint.h>
+
+// Bridge side expansion of compact spike trains (see "Bridge Packets" in
+// docs/packet_spec.md). Host packets pass through unchanged -- including the
+// variable length Configure Synapses, Input Fires and Input Fire Bitmap
+// packets, whose length is read from their header -- except for the
+// two sequencer opcodes. The spikes of each of those are sent together,
+// followed by a Simulate of the given number of steps:
+//
+//   SEQ_BITMAP: 0x20 value steps first count bitmap[(count + 7) / 8]
+//               fires input first + i for every set bit i (LSB first)
+//   SEQ_RLE:    0x21 value steps nruns (skip len)[nruns]
+//               starting from input 0, skips 'skip' inputs then fires
+//               the next 'len', for each run
+//
+// Input ids wrap at 256. The spikes are marked in a 256 input bitmap and
+// sent in whichever form is shortest: Input Fire packets (inputs 0-127 only),
+// one Input Fires, or one Input Fire Bitmap of the bytes from the lowest to
+// the highest input fired. A run that wraps onto an input it already fired
+// sends the spikes so far first, so every spike still reaches the FPGA.
+//
+// The output is written into a queue with SpscQueue's push()/space(). When
+// it is full feed() stops and returns the input consumed so far, so the
+// expansion is paced by the queue -- and through it by the FPGA RX FIFO
+// status -- rather than being buffered.
+class SpikeSequencer
+{
+public:
+   static const uint8_t SEQ_BITMAP = 0x20;
+   static const uint8_t SEQ_RLE    = 0x21;
+
+   // Feed host bytes, returns the number consumed
+   template <typename Q>
+   uint32_t feed(const uint8_t *buf, uint32_t len, Q &out)
+   {
+      uint32_t i = 0;
+
+      while (1) {
+         // states that only produce output
+         if (m_state == FIRE_RUN) {
+            for (; m_run > 0; --m_run, ++m_id) {
+               if (marked(m_id) && !flush(out)) return i;
+               mark(m_id);
+            }
+            m_state = (--m_runs > 0) ? RLE_SKIP : FLUSH;
+         }
+         if (m_state == FLUSH) {
+            if (!flush(out)) return i;
+            m_state = STEP;
+         }
+         if (m_state == STEP) {
+            if (m_steps > 0) {
+               uint8_t pck[2] = {STEP_OP, m_steps};
+               if (out.space() < 2) return i;
+               out.push(pck, 2);
+            }
+            m_state = OPCODE;
+         }
+
+         if (i == len) return i;
+         uint8_t b = buf[i];
+
+         switch (m_state) {
+         case OPCODE:
+            if (b == SEQ_BITMAP || b == SEQ_RLE) {
+               m_op = b;
+               m_hdr_len = 0;
+               m_state = SEQ_HDR;
+            } else {
+               if (out.push(&b, 1) == 0) return i;
+               m_op = b;
+               m_left = payload_size(b);
+               m_hdr_len = 0;
+               m_state = (header_size(b) > 0) ? LEN_HDR : (m_left > 0 ? PASS : OPCODE);
+            }
+            i++;
+            break;
+
+         case PASS: {
+            uint32_t n = out.push(&buf[i], (len - i < m_left) ? len - i : m_left);
+            if (n == 0) return i;
+            i += n;
+            m_left -= n;
+            if (m_left == 0) m_state = OPCODE;
+            break;
+         }
+
+         case LEN_HDR:
+            if (out.push(&b, 1) == 0) return i;
+            m_hdr[m_hdr_len++] = b;
+            i++;
+            if (m_hdr_len == header_size(m_op)) {
+               m_left = body_size(m_op, m_hdr);
+               m_state = (m_left > 0) ? PASS : OPCODE;
+            }
+            break;
+
+         case SEQ_HDR:
+            m_hdr[m_hdr_len++] = b;
+            i++;
+            if (m_op == SEQ_BITMAP && m_hdr_len == 4) {
+               m_value = m_hdr[0];
+               m_steps = m_hdr[1];
+               m_id    = m_hdr[2];
+               m_count = m_hdr[3];
+               m_left  = (m_count + 7) / 8;
+               m_state = (m_left > 0) ? BITMAP : FLUSH;
+            } else if (m_op == SEQ_RLE && m_hdr_len == 3) {
+               m_value = m_hdr[0];
+               m_steps = m_hdr[1];
+               m_runs  = m_hdr[2];
+               m_id    = 0;
+               m_state = (m_runs > 0) ? RLE_SKIP : FLUSH;
+            }
+            break;
+
+         case BITMAP:
+            // COUNT < 256, so a bitmap never marks an input twice
+            for (int bit = 0; bit < 8 && bit < m_count; ++bit) {
+               if (b & (1 << bit)) mark(m_id + bit);
+            }
+            m_id += 8;
+            m_count = (m_count > 8) ? m_count - 8 : 0;
+            i++;
+            if (--m_left == 0) m_state = FLUSH;
+            break;
+
+         case RLE_SKIP:
+            m_id += b;
+            i++;
+            m_state = RLE_LEN;
+            break;
+
+         case RLE_LEN:
+            m_run = b;
+            i++;
+            m_state = FIRE_RUN;
+            break;
+
+         default:
+            break;
+         }
+      }
+   }
+
+private:
+   static const uint8_t STEP_OP     = 0x01;
+   static const uint8_t FIRES_OP    = 0x06;
+   static const uint8_t FIRE_MAP_OP = 0x07;
+   static const uint8_t CFG_SYNS_OP = 0x11;
+
+   enum State { OPCODE, PASS, LEN_HDR, SEQ_HDR, BITMAP, RLE_SKIP, RLE_LEN, FIRE_RUN, FLUSH, STEP };
+
+   // Header bytes giving the length of a variable length packet, 0 if the
+   // opcode has a fixed length
+   static int header_size(uint8_t op)
+   {
+      switch (op) {
+      case FIRES_OP:     // COUNT
+         return 1;
+      case FIRE_MAP_OP:  // VALUE FIRST BYTES
+         return 3;
+      case CFG_SYNS_OP:  // START END
+         return 4;
+      default:
+         return 0;
+      }
+   }
+
+   // Bytes following the header of a variable length packet
+   static uint32_t body_size(uint8_t op, const uint8_t *hdr)
+   {
+      switch (op) {
+      case FIRES_OP:
+         return 2 * hdr[0];
+      case FIRE_MAP_OP:
+         return hdr[2];
+      default: {
+         uint16_t start = ((hdr[0] & 0x0F) << 8) | hdr[1];
+         uint16_t end   = ((hdr[2] & 0x0F) << 8) | hdr[3];
+         return 2 * (((end - start) & 0x0FFF) + 1);
+      }
+      }
+   }
+
+   // Bytes following a host -> uCaspian opcode (variable length: none, see
+   // header_size)
+   static uint32_t payload_size(uint8_t op)
+   {
+      if (op & 0x80) return 1;
+
+      switch (op) {
+      case 0x01:         // Simulate
+      case 0x02:         // Get Metric
+         return 1;
+      case 0x08:         // Configure Neuron
+         return 6;
+      case 0x10:         // Configure Synapse
+         return 4;
+      default:           // No Op, Clear, unknown
+         return 0;
+      }
+   }
+
+   bool marked(uint8_t id) const { return m_map[id / 8] & (1 << (id % 8)); }
+   void mark(uint8_t id) { m_map[id / 8] |= 1 << (id % 8); }
+
+   // Send the marked inputs in one packet and clear them. Returns false,
+   // keeping them marked, if the queue has no room for the packet.
+   template <typename Q>
+   bool flush(Q &out)
+   {
+      int lo = 0, hi = 31;
+      while (lo < 32 && m_map[lo] == 0) ++lo;
+      if (lo == 32) return true;
+      while (m_map[hi] == 0) --hi;
+
+      int n = 0;
+      for (int j = lo; j <= hi; ++j) n += __builtin_popcount(m_map[j]);
+
+      // the fires are only chosen when shorter than the bitmap (<= 36)
+      uint8_t pck[4 + 32];
+      uint32_t size = 0;
+      uint32_t map_size = 4 + (hi - lo + 1);
+      if (hi < 16 && 2 * (uint32_t)n < map_size) {
+         for (int id = 8 * lo; id < 8 * (hi + 1); ++id) {
+            if (!marked(id)) continue;
+            pck[size++] = 0x80 | id;
+            pck[size++] = m_value;
+         }
+      } else if (2 + 2 * (uint32_t)n < map_size) {
+         pck[size++] = FIRES_OP;
+         pck[size++] = n;
+         for (int id = 8 * lo; id < 8 * (hi + 1); ++id) {
+            if (!marked(id)) continue;
+            pck[size++] = id;
+            pck[size++] = m_value;
+         }
+      } else {
+         pck[size++] = FIRE_MAP_OP;
+         pck[size++] = m_value;
+         pck[size++] = 8 * lo;
+         pck[size++] = hi - lo + 1;
+         for (int j = lo; j <= hi; ++j) pck[size++] = m_map[j];
+      }
+
+      if (out.space() < size) return false;
+      out.push(pck, size);
+      for (int j = 0; j < 32; ++j) m_map[j] = 0;
+      return true;
+   }
+
+   State    m_state   = OPCODE;
+   uint8_t  m_op      = 0;
+   uint8_t  m_hdr[4]  = {};
+   int      m_hdr_len = 0;
+   uint32_t m_left    = 0;   // PASS: bytes to copy, BITMAP: bitmap bytes
+
+   uint8_t  m_value   = 0;
+   uint8_t  m_steps   = 0;
+   uint8_t  m_id      = 0;
+   uint8_t  m_count   = 0;   // inputs left in the bitmap
+   uint8_t  m_runs    = 0;
+   uint8_t  m_run     = 0;
+   uint8_t  m_map[32] = {};  // inputs marked to fire, bit i of byte j is input 8j + i
+};
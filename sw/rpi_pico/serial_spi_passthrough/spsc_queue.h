@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Lock-free single producer, single consumer byte queue for passing data
+// between the two RP2040 cores. Only plain loads and stores are used on the
+// indices (the M0+ has no atomic read-modify-write), with acquire/release
+// ordering so the data is visible before the index that publishes it.
+//
+// The producer and consumer get direct access to contiguous regions of the
+// buffer so DMA can read from / write into the queue without a copy.
+template <uint32_t N>
+class SpscQueue
+{
+   static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+   uint32_t size() const
+   {
+      return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+   }
+
+   uint32_t space() const
+   {
+      return N - size();
+   }
+
+   // Producer: contiguous free region, then publish 'n' bytes written to it
+   uint8_t *write_ptr(uint32_t &len)
+   {
+      uint32_t head = m_head.load(std::memory_order_relaxed);
+      uint32_t tail = m_tail.load(std::memory_order_acquire);
+      uint32_t start = head & (N - 1);
+
+      len = N - (head - tail);
+      if (len > N - start) len = N - start;
+      return &m_buf[start];
+   }
+
+   void commit(uint32_t n)
+   {
+      m_head.store(m_head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+   }
+
+   // Consumer: contiguous filled region, then release 'n' bytes read from it
+   const uint8_t *read_ptr(uint32_t &len)
+   {
+      uint32_t tail = m_tail.load(std::memory_order_relaxed);
+      uint32_t head = m_head.load(std::memory_order_acquire);
+      uint32_t start = tail & (N - 1);
+
+      len = head - tail;
+      if (len > N - start) len = N - start;
+      return &m_buf[start];
+   }
+
+   void consume(uint32_t n)
+   {
+      m_tail.store(m_tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+   }
+
+   // Copying helpers, return the number of bytes moved
+   uint32_t push(const uint8_t *data, uint32_t len)
+   {
+      uint32_t done = 0;
+      while (done < len) {
+         uint32_t n;
+         uint8_t *dst = write_ptr(n);
+         if (n == 0) break;
+         if (n > len - done) n = len - done;
+         for (uint32_t i = 0; i < n; ++i) dst[i] = data[done + i];
+         commit(n);
+         done += n;
+      }
+      return done;
+   }
+
+   uint32_t pop(uint8_t *data, uint32_t len)
+   {
+      uint32_t done = 0;
+      while (done < len) {
+         uint32_t n;
+         const uint8_t *src = read_ptr(n);
+         if (n == 0) break;
+         if (n > len - done) n = len - done;
+         for (uint32_t i = 0; i < n; ++i) data[done + i] = src[i];
+         consume(n);
+         done += n;
+      }
+      return done;
+   }
+
+private:
+   alignas(4) uint8_t m_buf[N];
+   std::atomic<uint32_t> m_head{0};   // written by the producer only
+   std::atomic<uint32_t> m_tail{0};   // written by the consumer only
+};
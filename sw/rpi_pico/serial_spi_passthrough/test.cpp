@@ -1,11 +1,17 @@
 #include <stdio.h>
 #include <string>
+#include <algorithm>
 #include "pico/stdlib.h"
 #include "pico/time.h"
 #include "hardware/gpio.h"
 #include "hardware/spi.h"
+#include "hardware/dma.h"
 #include "pico/binary_info.h"
 #include "pico/multicore.h"
+#include "tusb.h"
+
+#include "spsc_queue.h"
+#include "spike_sequencer.h"
 
 // SPI Defines
 // We are going to use SPI 0, and allocate it to the following GPIO pins
@@ -19,12 +25,21 @@
 #define READ_STATUS_OP      1
 #define READ_BYTES_OP       2
 #define WRITE_BYTES_OP      4
-#define WRITE_READ_BYTES_OP 6
+#define XFER_OP             7
 #define RESET_OP            8
 
 #define SPI_WIDTH 8
 #define SPI_DEPTH 16
-#define HOST_DEPTH 512
+
+// Passthrough buffering
+#define QUEUE_DEPTH 4096   // between the cores, each direction
+#define HOST_BUF    512    // host bytes waiting for the spike sequencer
+
+// Loopback self-test: core 1 returns the host's bytes instead of talking to
+// the FPGA, to check the USB link on its own (see scripts/serial_loopback.py)
+#ifndef USB_LOOPBACK
+#define USB_LOOPBACK 0
+#endif
 
 const uint LED_PIN = 25;
 
@@ -38,87 +53,159 @@ static inline void cs_deselect()
    gpio_put(PIN_CS, 1);
 }
 
-static void write_register(uint8_t reg, uint8_t *buf, uint16_t len)
-{
-   reg &= 0x7f;
-   cs_select();
-   spi_write_blocking(SPI_PORT, &reg, 1);
-   spi_write_blocking(SPI_PORT, buf, len);
-   cs_deselect();
-}
+// Queues between core 0 (host link) and core 1 (SPI to the FPGA)
+static SpscQueue<QUEUE_DEPTH> to_fpga_q;
+static SpscQueue<QUEUE_DEPTH> from_fpga_q;
 
-static void read_register(uint8_t reg, uint8_t *buf, uint16_t len)
-{
-   reg |= 0x80;
-   cs_select();
-   spi_write_blocking(SPI_PORT, &reg, 1);
-   spi_read_blocking(SPI_PORT, 0, buf, len);
-   cs_deselect();
-}
+// SPI DMA channels (core 1)
+static int spi_tx_chan;
+static int spi_rx_chan;
 
-static void write_read_register(uint8_t reg, uint8_t *wbuf, uint8_t *rbuf, uint16_t len)
+// Full duplex SPI transfer of len bytes over DMA. A null tx sends zeros,
+// a null rx discards the received bytes.
+static void spi_transfer_dma(const uint8_t *tx, uint8_t *rx, uint16_t len)
 {
-   reg |= 0x80;
-   cs_select();
-   spi_write_blocking(SPI_PORT, &reg, 1);
-   spi_write_read_blocking(SPI_PORT, wbuf, rbuf, len);
-   cs_deselect();
+   static uint8_t zero = 0;
+   static uint8_t sink;
+
+   dma_channel_config c = dma_channel_get_default_config(spi_tx_chan);
+   channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+   channel_config_set_dreq(&c, spi_get_dreq(SPI_PORT, true));
+   channel_config_set_read_increment(&c, tx != NULL);
+   channel_config_set_write_increment(&c, false);
+   dma_channel_configure(spi_tx_chan, &c, &spi_get_hw(SPI_PORT)->dr, tx ? tx : &zero, len, false);
+
+   c = dma_channel_get_default_config(spi_rx_chan);
+   channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+   channel_config_set_dreq(&c, spi_get_dreq(SPI_PORT, false));
+   channel_config_set_read_increment(&c, false);
+   channel_config_set_write_increment(&c, rx != NULL);
+   dma_channel_configure(spi_rx_chan, &c, rx ? rx : &sink, &spi_get_hw(SPI_PORT)->dr, len, false);
+
+   dma_start_channel_mask((1u << spi_tx_chan) | (1u << spi_rx_chan));
+   dma_channel_wait_for_finish_blocking(spi_rx_chan);
 }
 
-static void bi_directional()
+// Core 1: move bytes between the queues and the FPGA FIFOs, one XFER_OP
+// frame per iteration:
+//   MOSI: XFER_OP  wlen   rlen   data to the FPGA (max(wlen, rlen) bytes)
+//   MISO: -        avail  count  data from the FPGA
+// wlen and rlen are sized from the status of the previous frame. That is
+// safe as only this loop uses up write space or read data; the frame then
+// returns the current status for the next one.
+static uint8_t xfer_tx[3 + 255];
+static uint8_t xfer_rx[3 + 255];
+
+static void fpga_link_task()
 {
-   uint8_t buf[1];
+   spi_tx_chan = dma_claim_unused_channel(true);
+   spi_rx_chan = dma_claim_unused_channel(true);
+
+   uint32_t avail = 0, count = 0;
+   uint32_t len;
+
    while (1) {
-      uint8_t status[2];
-      read_register(READ_STATUS_OP, status, 2);
-      int16_t ch = getchar_timeout_us(1000);
-      if (ch != PICO_ERROR_TIMEOUT) {
-         buf[0] = (uint8_t)ch;
-         write_register(WRITE_BYTES_OP, buf, 1);
+      // HOST to FPGA
+      const uint8_t *src = to_fpga_q.read_ptr(len);
+      uint32_t wlen = std::min<uint32_t>(avail, len);
+
+      // FPGA to HOST
+      from_fpga_q.write_ptr(len);
+      uint32_t rlen = std::min<uint32_t>(count, len);
+
+      uint32_t n = std::max(wlen, rlen);
+      xfer_tx[0] = XFER_OP | 0x80;
+      xfer_tx[1] = wlen;
+      xfer_tx[2] = rlen;
+      std::copy(src, src + wlen, xfer_tx + 3);
+
+      cs_select();
+      spi_transfer_dma(xfer_tx, xfer_rx, 3 + n);
+      cs_deselect();
+
+      if (wlen > 0) {
+         gpio_put(LED_PIN, 1);
+         to_fpga_q.consume(wlen);
       }
-      sleep_ms(1000);
+      if (rlen > 0) {
+         gpio_put(LED_PIN, 0);
+         from_fpga_q.push(xfer_rx + 3, rlen);
+      }
+
+      // status from the start of this frame, less what it moved
+      avail = xfer_rx[1] - wlen;
+      count = xfer_rx[2] - rlen;
    }
 }
 
-static void passthrough()
+// Core 1 in loopback mode: everything the host sends comes straight back
+static void loopback_task()
 {
+   uint32_t len;
 
-   uint8_t from_fpga[SPI_DEPTH*2];
-   uint8_t from_fpga_buf_len = 0;
-   uint8_t from_fpga_transfer = 0;
+   while (1) {
+      const uint8_t *src = to_fpga_q.read_ptr(len);
+      if (len > 0) {
+         to_fpga_q.consume(from_fpga_q.push(src, len));
+      }
+   }
+}
 
-   uint8_t to_fpga[SPI_DEPTH*2];
-   uint8_t to_fpga_buf_len = 0;
-   uint8_t to_fpga_transfer = 0;
+// Core 0: service the host over TinyUSB CDC. Host bytes go through the
+// spike sequencer into to_fpga_q (in loopback mode straight from the CDC
+// FIFO), and bytes are written straight out of from_fpga_q, a contiguous
+// region at a time. TinyUSB sends each full 64 byte bulk packet as it
+// fills; the short tail is flushed once from_fpga_q runs dry, so a burst
+// costs one short packet at most.
+static SpikeSequencer sequencer;
+static uint8_t host_buf[HOST_BUF];
+
+static void host_link_task()
+{
+   tusb_init();
 
-   uint8_t status[2];
-   uint8_t rw_len = 1;
+   uint32_t len, n;
+   uint32_t host_len = 0, host_pos = 0;
+   bool unflushed = false;
 
    while (1) {
-      // FPGA to HOST
-      read_register(READ_STATUS_OP, status, 2);
-      if (uart_is_writable(uart_default))
-      {
-         from_fpga_transfer = status[1];
-         if (from_fpga_transfer > 0) {
-            gpio_put(LED_PIN, 0);
-            read_register(READ_BYTES_OP, from_fpga, from_fpga_transfer);
-            uart_write_blocking(uart_default, from_fpga, from_fpga_transfer);
+      tud_task();
+
+      // HOST to queue
+      if (USB_LOOPBACK) {
+         uint8_t *dst = to_fpga_q.write_ptr(len);
+         n = std::min<uint32_t>(len, tud_cdc_available());
+         if (n > 0) {
+            to_fpga_q.commit(tud_cdc_read(dst, n));
+         }
+      } else {
+         if (host_pos == host_len) {
+            host_len = tud_cdc_read(host_buf, HOST_BUF);
+            host_pos = 0;
          }
+         host_pos += sequencer.feed(&host_buf[host_pos], host_len - host_pos, to_fpga_q);
       }
 
-      // HOST to FPGA
-      read_register(READ_STATUS_OP, status, 2);
-      to_fpga_buf_len = uart_is_readable(uart_default);
-      to_fpga_transfer = std::min(to_fpga_buf_len, status[0]);
-      if (to_fpga_transfer > 0) {
-         gpio_put(LED_PIN, 1);
-         uart_read_blocking(uart_default, to_fpga, to_fpga_transfer);
-         write_register(WRITE_BYTES_OP, to_fpga, to_fpga_transfer);
+      // queue to HOST
+      const uint8_t *src = from_fpga_q.read_ptr(len);
+      n = std::min<uint32_t>(len, tud_cdc_write_available());
+      if (n > 0) {
+         from_fpga_q.consume(tud_cdc_write(src, n));
+         unflushed = true;
+      }
+      if (unflushed && from_fpga_q.size() == 0) {
+         tud_cdc_write_flush();
+         unflushed = false;
       }
    }
 }
 
+static void passthrough()
+{
+   multicore_launch_core1(USB_LOOPBACK ? loopback_task : fpga_link_task);
+   host_link_task();
+}
+
 int main()
 {
    bi_decl(bi_program_description("This is a test binary."));
@@ -0,0 +1,32 @@
+#pragma once
+
+// TinyUSB configuration for the passthrough: a single CDC interface
+// carrying the raw uCaspian byte stream.
+
+#ifndef CFG_TUSB_RHPORT0_MODE
+#define CFG_TUSB_RHPORT0_MODE   (OPT_MODE_DEVICE | OPT_MODE_FULL_SPEED)
+#endif
+
+#define CFG_TUSB_OS             OPT_OS_PICO
+
+#ifndef CFG_TUSB_MEM_SECTION
+#define CFG_TUSB_MEM_SECTION
+#endif
+
+#ifndef CFG_TUSB_MEM_ALIGN
+#define CFG_TUSB_MEM_ALIGN      __attribute__ ((aligned(4)))
+#endif
+
+#define CFG_TUD_ENDPOINT0_SIZE  64
+
+#define CFG_TUD_CDC             1
+#define CFG_TUD_MSC             0
+#define CFG_TUD_HID             0
+#define CFG_TUD_MIDI            0
+#define CFG_TUD_VENDOR          0
+
+// Bulk endpoints are 64 bytes at full speed. The software FIFOs are large
+// so a whole burst from the host is taken in one tud_cdc_read().
+#define CFG_TUD_CDC_EP_BUFSIZE  64
+#define CFG_TUD_CDC_RX_BUFSIZE  2048
+#define CFG_TUD_CDC_TX_BUFSIZE  2048
@@ -0,0 +1,94 @@
+#include "tusb.h"
+#include "pico/unique_id.h"
+
+// USB descriptors for the passthrough's single CDC interface
+
+#define USBD_VID 0x2E8A   // Raspberry Pi
+#define USBD_PID 0x000A   // Pico SDK CDC
+
+#define USBD_ITF_CDC     0
+#define USBD_ITF_MAX     2
+
+#define USBD_CDC_EP_CMD  0x81
+#define USBD_CDC_EP_OUT  0x02
+#define USBD_CDC_EP_IN   0x82
+#define USBD_CDC_CMD_MAX_SIZE 8
+
+#define USBD_STR_0       0
+#define USBD_STR_MANUF   1
+#define USBD_STR_PRODUCT 2
+#define USBD_STR_SERIAL  3
+#define USBD_STR_CDC     4
+
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+static const tusb_desc_device_t usbd_desc_device = {
+   .bLength            = sizeof(tusb_desc_device_t),
+   .bDescriptorType    = TUSB_DESC_DEVICE,
+   .bcdUSB             = 0x0200,
+   .bDeviceClass       = TUSB_CLASS_MISC,
+   .bDeviceSubClass    = MISC_SUBCLASS_COMMON,
+   .bDeviceProtocol    = MISC_PROTOCOL_IAD,
+   .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+   .idVendor           = USBD_VID,
+   .idProduct          = USBD_PID,
+   .bcdDevice          = 0x0100,
+   .iManufacturer      = USBD_STR_MANUF,
+   .iProduct           = USBD_STR_PRODUCT,
+   .iSerialNumber      = USBD_STR_SERIAL,
+   .bNumConfigurations = 1,
+};
+
+static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
+   TUD_CONFIG_DESCRIPTOR(1, USBD_ITF_MAX, USBD_STR_0, USBD_DESC_LEN, 0, 100),
+   TUD_CDC_DESCRIPTOR(USBD_ITF_CDC, USBD_STR_CDC, USBD_CDC_EP_CMD, USBD_CDC_CMD_MAX_SIZE,
+                      USBD_CDC_EP_OUT, USBD_CDC_EP_IN, CFG_TUD_CDC_EP_BUFSIZE),
+};
+
+static char usbd_serial_str[PICO_UNIQUE_BOARD_ID_SIZE_BYTES * 2 + 1];
+
+static const char *const usbd_desc_str[] = {
+   [USBD_STR_MANUF]   = "ORNL",
+   [USBD_STR_PRODUCT] = "uCaspian SPI Passthrough",
+   [USBD_STR_SERIAL]  = usbd_serial_str,
+   [USBD_STR_CDC]     = "uCaspian",
+};
+
+const uint8_t *tud_descriptor_device_cb(void)
+{
+   return (const uint8_t *)&usbd_desc_device;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index)
+{
+   (void)index;
+   return usbd_desc_cfg;
+}
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+   (void)langid;
+   static uint16_t desc_str[32];
+   uint8_t len;
+
+   if (!usbd_serial_str[0]) {
+      pico_get_unique_board_id_string(usbd_serial_str, sizeof(usbd_serial_str));
+   }
+
+   if (index == 0) {
+      desc_str[1] = 0x0409;   // English
+      len = 1;
+   } else {
+      if (index >= sizeof(usbd_desc_str) / sizeof(usbd_desc_str[0]) || !usbd_desc_str[index]) {
+         return NULL;
+      }
+      const char *str = usbd_desc_str[index];
+      for (len = 0; len < 31 && str[len]; ++len) {
+         desc_str[1 + len] = str[len];
+      }
+   }
+
+   // first element is the length (in bytes) and type
+   desc_str[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * len + 2));
+   return desc_str;
+}
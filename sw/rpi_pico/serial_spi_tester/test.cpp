@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "pico/time.h"
 #include "hardware/gpio.h"
@@ -20,11 +21,18 @@
 #define READ_BYTES_OP       2
 #define WRITE_BYTES_OP      4
 #define WRITE_READ_BYTES_OP 6
+#define XFER_OP             7
 #define RESET_OP            8
 
 #define SPI_WIDTH 8
 #define SPI_DEPTH 16
 
+// Benchmark sweep (see benchmark())
+#define BENCH_BYTES    65536   // bytes moved per configuration
+#define BENCH_RESET_MS 100     // settle time after a reset
+#define HIST_SUB_BITS  2       // latency bins: 4 per power of two, 1 us below 8 us
+#define HIST_BINS      60      // up to 65535 us, the last bin catches the rest
+
 const uint LED_PIN = 25;
 
 static inline void cs_select()
@@ -64,6 +72,20 @@ static void write_read_register(uint8_t reg, uint8_t *wbuf, uint8_t *rbuf, uint1
    cs_deselect();
 }
 
+// Full duplex XFER frame: writes wlen bytes, reads rlen bytes, and returns
+// the status from the start of the frame. wbuf and rbuf hold max(wlen, rlen).
+static void xfer_register(const uint8_t *wbuf, uint8_t wlen, uint8_t *rbuf, uint8_t rlen, uint8_t *status)
+{
+   uint8_t hdr[3] = {XFER_OP | 0x80, wlen, rlen};
+   uint8_t st[3];
+   cs_select();
+   spi_write_read_blocking(SPI_PORT, hdr, st, 3);
+   spi_write_read_blocking(SPI_PORT, wbuf, rbuf, wlen > rlen ? wlen : rlen);
+   cs_deselect();
+   status[0] = st[1];
+   status[1] = st[2];
+}
+
 static void bi_directional()
 {
    uint8_t buf[1];
@@ -297,6 +319,189 @@ static void speed_test_noflow()
    read_register(READ_BYTES_OP, rbuf, SPI_DEPTH);
 }
 
+// Per-transaction latency histogram
+struct LatencyHist
+{
+   uint32_t bin[HIST_BINS];
+   uint32_t count;
+   uint64_t sum;
+   uint32_t min;
+   uint32_t max;
+};
+
+static void hist_clear(LatencyHist *h)
+{
+   memset(h, 0, sizeof(*h));
+   h->min = UINT32_MAX;
+}
+
+// Bin i < 8 holds i us. Above that each power of two [2^e, 2^(e+1)) is split
+// into 4 bins of 2^(e-2) us, so a bin is at most a quarter of its latency.
+static uint32_t hist_bin(uint32_t us)
+{
+   const uint32_t sub = 1u << HIST_SUB_BITS;
+   if (us < 2 * sub) return us;
+
+   uint32_t shift = 31 - __builtin_clz(us) - HIST_SUB_BITS;
+   uint32_t i = shift * sub + (us >> shift);
+   return i < HIST_BINS ? i : HIST_BINS - 1;
+}
+
+// Lowest latency of bin i, and its width in us
+static uint32_t hist_lower(uint32_t i, uint32_t *width)
+{
+   const uint32_t sub = 1u << HIST_SUB_BITS;
+   uint32_t shift = (i < 2 * sub) ? 0 : i / sub - 1;
+   *width = 1u << shift;
+   return (i - shift * sub) << shift;
+}
+
+static void hist_add(LatencyHist *h, uint32_t us)
+{
+   h->bin[hist_bin(us)]++;
+   h->count++;
+   h->sum += us;
+   if (us < h->min) h->min = us;
+   if (us > h->max) h->max = us;
+}
+
+// Latency of the p-th percentile in us. Exact below 8 us; in wider bins the
+// samples are taken as spread evenly over the bin, within min and max.
+static double hist_percentile(const LatencyHist *h, uint32_t p)
+{
+   uint64_t target = ((uint64_t)h->count * p + 99) / 100;
+   uint64_t seen = 0;
+   for (uint32_t i = 0; i < HIST_BINS; ++i) {
+      if (seen + h->bin[i] >= target && h->bin[i] > 0) {
+         uint32_t width;
+         double us = hist_lower(i, &width) +
+                     (width - 1) * ((target - seen) - 0.5) / h->bin[i];
+         if (i == HIST_BINS - 1 || us > h->max) us = h->max;
+         return us < h->min ? h->min : us;
+      }
+      seen += h->bin[i];
+   }
+   return h->max;
+}
+
+enum FlowMode { FLOW_NONE, FLOW_STATUS, FLOW_XFER };
+static const char *flow_names[] = {"none", "status", "xfer"};
+
+// Move BENCH_BYTES through the FPGA loopback in 'chunk' byte transactions:
+//   none   - WRITE_READ_BYTES back to back, no status check
+//   status - poll READ_STATUS until a whole chunk fits, then WRITE_READ_BYTES
+//   xfer   - XFER frames, sized from the status piggybacked on the last one
+// The write stream is a counter and every byte read back is checked against
+// it, so lost or repeated bytes (without flow control) count as errors.
+// Prints one CSV row.
+static void bench_run(FlowMode mode, uint32_t clock_hz, uint8_t chunk)
+{
+   uint8_t wbuf[SPI_DEPTH];
+   uint8_t rbuf[SPI_DEPTH];
+   uint8_t status[2];
+   uint8_t tx_seq = 0, rx_seq = 0;
+   uint32_t errors = 0;
+   LatencyHist hist;
+
+   hist_clear(&hist);
+
+   write_register(RESET_OP, wbuf, 0);
+   sleep_ms(BENCH_RESET_MS);
+
+   // prime the read side with one chunk
+   for (int i = 0; i < chunk; ++i) wbuf[i] = tx_seq++;
+   write_register(WRITE_BYTES_OP, wbuf, chunk);
+   read_register(READ_STATUS_OP, status, 2);
+
+   uint32_t transactions = BENCH_BYTES / chunk;
+   absolute_time_t start = get_absolute_time();
+
+   for (uint32_t t = 0; t < transactions; ++t) {
+      for (int i = 0; i < chunk; ++i) wbuf[i] = tx_seq++;
+
+      absolute_time_t tick = get_absolute_time();
+      switch (mode) {
+      case FLOW_NONE:
+         write_read_register(WRITE_READ_BYTES_OP, wbuf, rbuf, chunk);
+         break;
+      case FLOW_STATUS:
+         do {
+            read_register(READ_STATUS_OP, status, 2);
+         } while (status[0] < chunk || status[1] < chunk);
+         write_read_register(WRITE_READ_BYTES_OP, wbuf, rbuf, chunk);
+         break;
+      case FLOW_XFER:
+         // status[] is the space/count left after the previous frame
+         while (status[0] < chunk || status[1] < chunk) {
+            xfer_register(wbuf, 0, rbuf, 0, status);
+         }
+         xfer_register(wbuf, chunk, rbuf, chunk, status);
+         status[0] -= chunk;
+         status[1] -= chunk;
+         break;
+      }
+      absolute_time_t tock = get_absolute_time();
+      hist_add(&hist, (uint32_t)absolute_time_diff_us(tick, tock));
+
+      for (int i = 0; i < chunk; ++i) {
+         if (rbuf[i] != rx_seq++) errors++;
+      }
+   }
+
+   int64_t total_us = absolute_time_diff_us(start, get_absolute_time());
+
+   // drain the primed chunk
+   read_register(READ_BYTES_OP, rbuf, chunk);
+
+   uint32_t bytes = transactions * chunk;
+   printf("%s,%lu,%u,%lu,%lu,%lu,%lld,%.3f,%lu,%.2f,%.1f,%.1f,%lu",
+          flow_names[mode], (unsigned long)clock_hz, chunk, (unsigned long)bytes,
+          (unsigned long)transactions, (unsigned long)errors, (long long)total_us,
+          total_us > 0 ? (double)bytes * 8 / total_us : 0.0,
+          (unsigned long)hist.min, (double)hist.sum / hist.count,
+          hist_percentile(&hist, 50), hist_percentile(&hist, 99),
+          (unsigned long)hist.max);
+   for (int i = 0; i < HIST_BINS; ++i) {
+      printf(",%lu", (unsigned long)hist.bin[i]);
+   }
+   printf("\n");
+}
+
+// Sweep SPI clock, chunk size and flow control mode and print one CSV row
+// per configuration between "# begin"/"# end" markers, for
+// scripts/spi_bench_capture.py. Latencies are in us, hist_N counts the
+// transactions that took from N us up to the next column's N (the last
+// column everything slower).
+static void benchmark()
+{
+   static const uint32_t clocks_mhz[] = {1, 2, 5, 10, 15, 20, 25, 30, 40, 50};
+   static const uint8_t chunks[] = {1, 2, 4, 8, SPI_DEPTH};
+
+   printf("# begin spi benchmark\n");
+   printf("mode,clock_hz,chunk,bytes,transactions,errors,total_us,mbps,"
+          "lat_min_us,lat_mean_us,lat_p50_us,lat_p99_us,lat_max_us");
+   for (uint32_t i = 0; i < HIST_BINS; ++i) {
+      uint32_t width;
+      printf(",hist_%lu", (unsigned long)hist_lower(i, &width));
+   }
+   printf("\n");
+
+   for (uint32_t c = 0; c < sizeof(clocks_mhz) / sizeof(clocks_mhz[0]); ++c) {
+      // the actual rate is the nearest the SPI divider can make
+      uint32_t clock_hz = spi_set_baudrate(SPI_PORT, clocks_mhz[c] * 1000 * 1000);
+
+      for (uint32_t n = 0; n < sizeof(chunks); ++n) {
+         for (int mode = FLOW_NONE; mode <= FLOW_XFER; ++mode) {
+            bench_run((FlowMode)mode, clock_hz, chunks[n]);
+         }
+      }
+   }
+
+   printf("# end spi benchmark\n");
+
+   spi_set_baudrate(SPI_PORT, 1000*1000*30);
+}
+
 static void manual_test()
 {
    uint8_t rbuf[SPI_DEPTH*2];
@@ -380,6 +585,9 @@ static void manual_test()
          case 'W':
             speed_test_noflow();
             break;
+         case 'b':
+            benchmark();
+            break;
          case '?':
             printf("\nCommands:\n");
             printf("  1-8   - Set rw_len to value.\n");
@@ -392,6 +600,7 @@ static void manual_test()
             printf("  t     - Run automated tests.\n");
             printf("  w     - Run speed test.\n");
             printf("  W     - Rune speed test (No flow control).\n");
+            printf("  b     - Run benchmark sweep (CSV).\n");
             printf("  R     - Send reset to FPGA over SPI.\n");
             printf("  ?     - Show help.\n");
             printf("  other - Write rw_len of 'other'\n");
@@ -512,6 +721,10 @@ int main()
 
    // bi_directional();
 
+#ifdef SPI_BENCHMARK
+   benchmark();
+#endif
+
    manual_test();
 
    // host_to_fpga();